@@ -0,0 +1,212 @@
+#!/bin/sh
+#
+# Benchmark driver for the relaxation solver
+#
+# Runs every combination of the given sizes, thread counts, precisions and
+# solver variants, each a number of times after some warmup runs, and writes
+# the median, minimum and standard deviation of the total time along with the
+# medians of the sequential and parallel parts.
+#
+# The CSV output starts with the columns of results.csv (size, threads,
+# precision, time), where time is the median, so it can be appended to it or
+# charted the same way. The JSON output holds the same results together with
+# the machine and build they were measured on, with the size as a string since
+# it may be WxH.
+#
+# Usage: sh benchmark.sh [options]
+#   -s sizes        space separated matrix sizes, N or WxH (default "100 200 300")
+#   -t threads      space separated thread counts (default "1 2 4")
+#   -p precisions   space separated precisions (default "3")
+#   -v variants     ';' separated extra solver arguments, "default" for none
+#                   (default "default"), e.g. "default;-i;-k 9;-a chebyshev"
+#   -r repetitions  measured runs per configuration (default 5)
+#   -w warmups      unmeasured runs per configuration (default 1)
+#   -b binary       solver to run (default ./relaxation)
+#   -m target       make target to build before running (default none)
+#   -l launcher     command the binary is run through, e.g. "mpirun -np 4"
+#   -S              run the sequential backend (-x sequential) on a single block
+#   -o prefix       write prefix.csv and prefix.json (default bench_output)
+#
+
+SIZES="100 200 300"
+THREADS="1 2 4"
+PRECISIONS="3"
+VARIANTS="default"
+REPETITIONS=5
+WARMUPS=1
+BINARY=./relaxation
+TARGET=""
+LAUNCHER=""
+SEQUENTIAL=0
+PREFIX=bench_output
+
+while getopts "s:t:p:v:r:w:b:m:l:So:" option
+do
+    case $option in
+        s) SIZES=$OPTARG ;;
+        t) THREADS=$OPTARG ;;
+        p) PRECISIONS=$OPTARG ;;
+        v) VARIANTS=$OPTARG ;;
+        r) REPETITIONS=$OPTARG ;;
+        w) WARMUPS=$OPTARG ;;
+        b) BINARY=$OPTARG ;;
+        m) TARGET=$OPTARG ;;
+        l) LAUNCHER=$OPTARG ;;
+        S) SEQUENTIAL=1 ;;
+        o) PREFIX=$OPTARG ;;
+        *) sed -n '/^# Usage/,/^$/p' "$0"; exit 1 ;;
+    esac
+done
+
+# the sequential backend has no thread count to sweep
+if [ $SEQUENTIAL -eq 1 ]
+then
+    THREADS=1
+fi
+
+if [ -n "$TARGET" ]
+then
+    make "$TARGET" >&2 || exit 1
+fi
+if [ ! -x "$BINARY" ]
+then
+    echo "No solver at $BINARY, build it or pass -m <target>" >&2
+    exit 1
+fi
+
+# escapes a value for use inside a JSON string
+json_escape() {
+    printf '%s' "$1" | sed -e 's/\\/\\\\/g' -e 's/"/\\"/g'
+}
+
+# describe the machine and build the results come from
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+if [ -n "$(git status --porcelain --untracked-files=no 2>/dev/null)" ]
+then
+    COMMIT="$COMMIT-dirty"
+fi
+HOST=$(hostname)
+KERNEL=$(uname -sr)
+CPU=$(sed -n 's/^model name[[:space:]]*: //p' /proc/cpuinfo 2>/dev/null | head -n 1)
+CPUS=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo unknown)
+COMPILER=$(gcc --version 2>/dev/null | head -n 1)
+BINARY_SUM=$(md5sum "$BINARY" 2>/dev/null | cut -d ' ' -f 1)
+DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+
+CSV="$PREFIX.csv"
+JSON="$PREFIX.json"
+TIMES=$(mktemp)
+trap 'rm -f "$TIMES"' EXIT
+
+echo "size, threads, precision, time, min, stddev, sequential, parallel, repetitions, variant, commit, host" > "$CSV"
+{
+    echo "{"
+    echo "  \"metadata\": {"
+    echo "    \"date\": \"$DATE\","
+    echo "    \"host\": \"$(json_escape "$HOST")\","
+    echo "    \"kernel\": \"$(json_escape "$KERNEL")\","
+    echo "    \"cpu\": \"$(json_escape "$CPU")\","
+    echo "    \"cpus\": \"$CPUS\","
+    echo "    \"compiler\": \"$(json_escape "$COMPILER")\","
+    echo "    \"make_target\": \"$(json_escape "$TARGET")\","
+    echo "    \"launcher\": \"$(json_escape "$LAUNCHER")\","
+    echo "    \"binary\": \"$(json_escape "$BINARY")\","
+    echo "    \"binary_md5\": \"$BINARY_SUM\","
+    echo "    \"commit\": \"$COMMIT\","
+    echo "    \"repetitions\": $REPETITIONS,"
+    echo "    \"warmups\": $WARMUPS"
+    echo "  },"
+    echo "  \"results\": ["
+} > "$JSON"
+
+FIRST=1
+OLD_IFS=$IFS
+for SIZE in $SIZES
+do
+for THREAD_COUNT in $THREADS
+do
+for PRECISION in $PRECISIONS
+do
+IFS=';'
+for VARIANT in $VARIANTS
+do
+    IFS=$OLD_IFS
+    ARGUMENTS=$VARIANT
+    if [ "$VARIANT" = "default" ]
+    then
+        ARGUMENTS=""
+    fi
+    if [ $SEQUENTIAL -eq 1 ]
+    then
+        COMMAND="$LAUNCHER $BINARY $SIZE 1 $PRECISION -x sequential $ARGUMENTS"
+    else
+        COMMAND="$LAUNCHER $BINARY $SIZE $THREAD_COUNT $PRECISION $ARGUMENTS"
+    fi
+
+    i=0
+    while [ $i -lt "$WARMUPS" ]
+    do
+        $COMMAND > /dev/null
+        i=$((i+1))
+    done
+
+    # the solver prints "size, total, sequential, parallel" as its last line
+    : > "$TIMES"
+    i=0
+    while [ $i -lt "$REPETITIONS" ]
+    do
+        if ! OUTPUT=$($COMMAND)
+        then
+            echo "Failed: $COMMAND" >&2
+            exit 1
+        fi
+        echo "$OUTPUT" | tail -n 1 >> "$TIMES"
+        i=$((i+1))
+    done
+
+    # sort by total time, then take the statistics of each column
+    STATISTICS=$(sort -t ',' -k 2 -g "$TIMES" | awk -F ', *' '
+        {
+            total[NR] = $2; sequential[NR] = $3; parallel[NR] = $4
+            sum += $2; sum_squares += $2*$2
+        }
+        function median(values, count,    sorted, i, j, swap) {
+            for (i=1 ; i<=count ; i++) sorted[i] = values[i]
+            for (i=2 ; i<=count ; i++)
+                for (j=i ; j>1 && sorted[j-1] > sorted[j] ; j--) {
+                    swap = sorted[j]; sorted[j] = sorted[j-1]; sorted[j-1] = swap
+                }
+            if (count%2) return sorted[(count+1)/2]
+            return (sorted[count/2] + sorted[count/2+1])/2
+        }
+        END {
+            mean = sum/NR
+            variance = NR > 1 ? (sum_squares - NR*mean*mean)/(NR-1) : 0
+            if (variance < 0) variance = 0
+            printf "%f %f %f %f %f\n", median(total, NR), total[1], sqrt(variance),
+                median(sequential, NR), median(parallel, NR)
+        }')
+    set -- $STATISTICS
+
+    echo "$SIZE, $THREAD_COUNT, $PRECISION, $1, $2, $3, $4, $5, $REPETITIONS, \"$VARIANT\", $COMMIT, $HOST" >> "$CSV"
+    echo "$SIZE, $THREAD_COUNT, $PRECISION, $1 ($VARIANT)" >&2
+
+    if [ $FIRST -eq 0 ]
+    then
+        echo "," >> "$JSON"
+    fi
+    FIRST=0
+    printf '    {"size": "%s", "threads": %s, "precision": %s, "variant": "%s", "median": %s, "min": %s, "stddev": %s, "sequential": %s, "parallel": %s}' \
+        "$SIZE" "$THREAD_COUNT" "$PRECISION" "$(json_escape "$VARIANT")" "$1" "$2" "$3" "$4" "$5" >> "$JSON"
+    IFS=';'
+done
+IFS=$OLD_IFS
+done
+done
+done
+
+{
+    echo
+    echo "  ]"
+    echo "}"
+} >> "$JSON"
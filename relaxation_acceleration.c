@@ -0,0 +1,311 @@
+/**
+* Acceleration of the Jacobi iteration
+* Oliver Redeyoff
+*
+* Both methods leave the relaxation itself untouched: each sweep still computes
+* the Jacobi update g = J(x) of the current matrix x into the blocks' new_values
+* with the usual kernels, and the acceleration only changes which combination of
+* that update and earlier iterates becomes the next matrix. All of the per cell
+* work is done by the worker threads on their own blocks, the main thread only
+* handles the per iteration scalars.
+*
+* Chebyshev semi-iteration replaces g with w(g - x_prev) + x_prev, where x_prev
+* is the matrix from the iteration before and the weights w follow from an
+* estimate of the spectral radius of J, which for these problems only depends
+* on the grid size and stencil.
+*
+* Anderson mixing remembers the differences between the last m updates (dG) and
+* residuals f = g - x (dF), and takes the next matrix to be g - dG gamma, where
+* gamma minimises |f - dF gamma|. Each thread adds its block's share of the dot
+* products to its own slot, the main thread sums them and solves for gamma, then
+* the threads apply gamma to their blocks in an extra parallel update step.
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "relaxation_technique.h"
+
+// the largest history Anderson mixing can be asked to keep
+#define ANDERSON_MAX_DEPTH 16
+
+int acceleration;
+int anderson_depth;
+
+// the relaxation and update steps the acceleration wraps
+static void (*base_process_block)(BLOCK* block);
+static void (*base_update_values)();
+
+// number of updates done so far, and Chebyshev's estimate of the spectral radius
+// of J together with the weight for the current iteration
+static int iteration;
+static double spectral_radius;
+static double chebyshev_weight;
+
+// matrix from the previous iteration, for Chebyshev
+static double* previous_values;
+
+// Anderson history of residual and update differences, kept as rings of depth
+// grids, the residual and update from the previous iteration, the Gram matrix of
+// the residual differences and the per block partial dot products
+static double* delta_residuals[ANDERSON_MAX_DEPTH];
+static double* delta_updates[ANDERSON_MAX_DEPTH];
+static double* previous_residual;
+static double* previous_update;
+static double gram[ANDERSON_MAX_DEPTH][ANDERSON_MAX_DEPTH];
+static double gamma_values[ANDERSON_MAX_DEPTH];
+static double* partial_products;
+static int partial_stride;
+
+// Returns the estimated spectral radius of the Jacobi iteration for the current
+// grid size and stencil, from the slowest mode across and down the grid. The
+// estimate is exact for the Laplace problem with Dirichlet sides, and uses the
+// slowest mode of a grid twice as large when a side is Neumann, as that mode no
+// longer has to vanish on the Neumann sides
+static double estimateSpectralRadius(int stencil) {
+    double across_intervals = matrix_width - 1;
+    double down_intervals = matrix_height - 1;
+    if (hasNeumannBoundaries()) {
+        across_intervals *= 2;
+        down_intervals *= 2;
+    }
+    double c_across = cos(M_PI/across_intervals);
+    double c_down = cos(M_PI/down_intervals);
+
+    if (stencil == STENCIL_9_POINT) {
+        return (8*c_across + 8*c_down + 4*c_across*c_down)/20;
+    }
+    return (c_across + c_down)/2;
+}
+
+// Mixes the Jacobi update in the block's new_values with the previous iterate,
+// after the block's relaxation has computed it
+void processChebyshevBlock(BLOCK* block) {
+    base_process_block(block);
+
+    double weight = chebyshev_weight;
+
+    for (int row=block->start_row ; row<=block->end_row ; row++) {
+        double* current_row = &matrix[row*row_stride];
+        double* previous_row = &previous_values[row*row_stride];
+        double* new_row = &block->new_values[(row-block->start_row)*row_stride];
+
+        for (int j=1 ; j<matrix_width-1 ; j++) {
+            new_row[j] = weight*(new_row[j] - previous_row[j]) + previous_row[j];
+            previous_row[j] = current_row[j];
+        }
+    }
+}
+
+// Applies the mixed values and moves on to the next Chebyshev weight
+void updateChebyshev() {
+    base_update_values();
+
+    iteration++;
+    double radius_squared = spectral_radius*spectral_radius;
+    if (iteration == 1) {
+        chebyshev_weight = 1/(1 - radius_squared/2);
+    } else {
+        chebyshev_weight = 1/(1 - radius_squared*chebyshev_weight/4);
+    }
+}
+
+// Records the block's newest residual and update differences after the block's
+// relaxation, and adds its share of the dot products of the newest residual
+// difference and of the residual with every residual difference in the history
+void processAndersonBlock(BLOCK* block) {
+    base_process_block(block);
+
+    int history = iteration < anderson_depth ? iteration : anderson_depth;
+    int newest = (iteration - 1 + anderson_depth)%anderson_depth;
+    double* products = &partial_products[(block - blocks)*partial_stride];
+    memset(products, 0, 2*anderson_depth*sizeof(double));
+
+    for (int row=block->start_row ; row<=block->end_row ; row++) {
+        double* current_row = &matrix[row*row_stride];
+        double* new_row = &block->new_values[(row-block->start_row)*row_stride];
+
+        for (int j=1 ; j<matrix_width-1 ; j++) {
+            int index = row*row_stride + j;
+            double residual = new_row[j] - current_row[j];
+
+            if (history > 0) {
+                delta_residuals[newest][index] = residual - previous_residual[index];
+                delta_updates[newest][index] = new_row[j] - previous_update[index];
+
+                for (int i=0 ; i<history ; i++) {
+                    products[i] += delta_residuals[i][index]*delta_residuals[newest][index];
+                    products[anderson_depth + i] += delta_residuals[i][index]*residual;
+                }
+            }
+
+            previous_residual[index] = residual;
+            previous_update[index] = new_row[j];
+        }
+    }
+}
+
+// Solves the history x history system a gamma = b, in place, by Gaussian
+// elimination with partial pivoting
+static void solveSmallSystem(double a[ANDERSON_MAX_DEPTH][ANDERSON_MAX_DEPTH], double* b, int history) {
+    for (int col=0 ; col<history ; col++) {
+        int pivot = col;
+        for (int row=col+1 ; row<history ; row++) {
+            if (fabs(a[row][col]) > fabs(a[pivot][col])) {
+                pivot = row;
+            }
+        }
+        for (int k=0 ; k<history ; k++) {
+            double swap = a[col][k];
+            a[col][k] = a[pivot][k];
+            a[pivot][k] = swap;
+        }
+        double swap = b[col];
+        b[col] = b[pivot];
+        b[pivot] = swap;
+
+        for (int row=col+1 ; row<history ; row++) {
+            double factor = a[row][col]/a[col][col];
+            for (int k=col ; k<history ; k++) {
+                a[row][k] -= factor*a[col][k];
+            }
+            b[row] -= factor*b[col];
+        }
+    }
+
+    for (int row=history-1 ; row>=0 ; row--) {
+        for (int k=row+1 ; k<history ; k++) {
+            b[row] -= a[row][k]*b[k];
+        }
+        b[row] /= a[row][row];
+    }
+}
+
+// Sums the blocks' dot products into the Gram matrix and solves the regularised
+// least squares problem for gamma
+void updateAnderson() {
+    int history = iteration < anderson_depth ? iteration : anderson_depth;
+    int newest = (iteration - 1 + anderson_depth)%anderson_depth;
+    double right_side[ANDERSON_MAX_DEPTH];
+
+    for (int i=0 ; i<history ; i++) {
+        double column_sum = 0;
+        right_side[i] = 0;
+        for (int b=0 ; b<thread_count ; b++) {
+            column_sum += partial_products[b*partial_stride + i];
+            right_side[i] += partial_products[b*partial_stride + anderson_depth + i];
+        }
+        gram[i][newest] = column_sum;
+        gram[newest][i] = column_sum;
+    }
+
+    // regularise relative to the size of the Gram matrix, so that nearly
+    // parallel differences don't make the system singular
+    double system[ANDERSON_MAX_DEPTH][ANDERSON_MAX_DEPTH];
+    double trace = 0;
+    for (int i=0 ; i<history ; i++) {
+        trace += gram[i][i];
+    }
+    for (int i=0 ; i<history ; i++) {
+        for (int k=0 ; k<history ; k++) {
+            system[i][k] = gram[i][k];
+        }
+        system[i][i] += 1e-10*trace/history + 1e-300;
+    }
+
+    solveSmallSystem(system, right_side, history);
+    for (int i=0 ; i<history ; i++) {
+        gamma_values[i] = right_side[i];
+    }
+
+    iteration++;
+}
+
+// Writes the mixed iterate g - dG gamma for the block to matrix
+void updateAndersonBlock(BLOCK* block) {
+    int history = iteration-1 < anderson_depth ? iteration-1 : anderson_depth;
+
+    for (int row=block->start_row ; row<=block->end_row ; row++) {
+        double* current_row = &matrix[row*row_stride];
+        double* new_row = &block->new_values[(row-block->start_row)*row_stride];
+
+        for (int j=1 ; j<matrix_width-1 ; j++) {
+            int index = row*row_stride + j;
+            double value = new_row[j];
+            for (int i=0 ; i<history ; i++) {
+                value -= gamma_values[i]*delta_updates[i][index];
+            }
+            current_row[j] = value;
+        }
+    }
+}
+
+// Reads an acceleration from a spec of the form chebyshev or anderson[:depth].
+// Returns 0 on success and 1 if the spec could not be understood
+int parseAcceleration(char* spec) {
+    if (strcmp(spec, "none") == 0) {
+        acceleration = ACCELERATION_NONE;
+        return 0;
+    }
+    if (strcmp(spec, "chebyshev") == 0) {
+        acceleration = ACCELERATION_CHEBYSHEV;
+        return 0;
+    }
+    if (strncmp(spec, "anderson", 8) == 0) {
+        acceleration = ACCELERATION_ANDERSON;
+        anderson_depth = 5;
+        if (spec[8] == ':') {
+            anderson_depth = atoi(&spec[9]);
+        } else if (spec[8] != '\0') {
+            return 1;
+        }
+        return anderson_depth < 1 || anderson_depth > ANDERSON_MAX_DEPTH;
+    }
+    return 1;
+}
+
+// Wraps the current relaxation and update steps with the chosen acceleration,
+// which must be called once matrix and blocks exist. Returns 0 on success and 1
+// if the acceleration can't be used with the problem
+int setUpAcceleration(int stencil) {
+    int cells = matrix_height*row_stride;
+
+    base_process_block = process_block;
+    base_update_values = update_values;
+    iteration = 0;
+
+    if (acceleration == ACCELERATION_CHEBYSHEV) {
+        spectral_radius = estimateSpectralRadius(stencil);
+        chebyshev_weight = 1;
+        previous_values = malloc(cells*sizeof(double));
+        memcpy(previous_values, matrix, cells*sizeof(double));
+
+        process_block = processChebyshevBlock;
+        update_values = updateChebyshev;
+    } else if (acceleration == ACCELERATION_ANDERSON) {
+        if (hasNeumannBoundaries()) {
+            printf("Anderson acceleration does not support Neumann boundaries\n");
+            return 1;
+        }
+
+        for (int i=0 ; i<anderson_depth ; i++) {
+            delta_residuals[i] = calloc(cells, sizeof(double));
+            delta_updates[i] = calloc(cells, sizeof(double));
+        }
+        previous_residual = calloc(cells, sizeof(double));
+        previous_update = calloc(cells, sizeof(double));
+
+        // give every block its own cache lines for its dot products
+        partial_stride = (2*anderson_depth + 7)/8*8;
+        partial_products = calloc(thread_count*partial_stride, sizeof(double));
+
+        process_block = processAndersonBlock;
+        update_values = updateAnderson;
+        update_block = updateAndersonBlock;
+    }
+
+    return 0;
+}
@@ -0,0 +1,274 @@
+/**
+* Memory bandwidth calibration
+* Oliver Redeyoff
+*
+* Calibration (-B max_threads) measures the memory bandwidth this machine can
+* sustain with 1 to max_threads threads, STREAM style: every thread runs the
+* copy, scale, add and triad kernels over its share of three arrays far larger
+* than any cache, the best of several repetitions is kept, and the results are
+* cached per host in a file.
+*
+* Every solve then looks up the triad bandwidth for the number of threads its
+* backend runs and reports how many bytes each sweep moves, according to the
+* model in getBytesPerCell(), and which share of the attainable bandwidth the
+* solve achieved. A solve well
+* below the roofline is held back by synchronisation or compute, one close to
+* it can only get faster by moving fewer bytes.
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "relaxation_technique.h"
+
+// length of each array, three of which take 384MB
+#define STREAM_ARRAY_LENGTH (1 << 24)
+#define STREAM_REPETITIONS 5
+
+#define STREAM_COPY 0
+#define STREAM_SCALE 1
+#define STREAM_ADD 2
+#define STREAM_TRIAD 3
+#define STREAM_KERNEL_COUNT 4
+
+typedef struct stream_thread {
+    int start;
+    int end;
+} STREAM_THREAD;
+
+static double* stream_a;
+static double* stream_b;
+static double* stream_c;
+static int stream_kernel;
+static int stream_finished;
+static pthread_barrier_t stream_start;
+static pthread_barrier_t stream_end;
+
+static const char* stream_kernel_names[] = {"copy", "scale", "add", "triad"};
+// bytes each kernel reads and writes per element, not counting write allocation
+static const int stream_kernel_bytes[] = {16, 16, 24, 24};
+
+// Returns the file bandwidth calibrations are cached in
+static const char* getCacheFile() {
+    static char path[4096];
+    const char* file = getenv("RELAXATION_BANDWIDTH_CACHE");
+    if (file != NULL) {
+        return file;
+    }
+    const char* home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/.relaxation_bandwidth", home != NULL ? home : ".");
+    return path;
+}
+
+// Entry point for calibration threads, which touch their share of the arrays
+// first so that it ends up in their local memory, then run whichever kernel
+// the main thread asks for between the two barriers until told to finish
+static void* initStreamThread(void* vargp) {
+    STREAM_THREAD* range = (STREAM_THREAD*)vargp;
+    double scalar = 3.0;
+
+    for (int i=range->start ; i<range->end ; i++) {
+        stream_a[i] = 1.0;
+        stream_b[i] = 2.0;
+        stream_c[i] = 0.0;
+    }
+
+    while (1) {
+        pthread_barrier_wait(&stream_start);
+        if (stream_finished) {
+            return NULL;
+        }
+
+        switch (stream_kernel) {
+        case STREAM_COPY:
+            for (int i=range->start ; i<range->end ; i++) stream_c[i] = stream_a[i];
+            break;
+        case STREAM_SCALE:
+            for (int i=range->start ; i<range->end ; i++) stream_b[i] = scalar*stream_c[i];
+            break;
+        case STREAM_ADD:
+            for (int i=range->start ; i<range->end ; i++) stream_c[i] = stream_a[i] + stream_b[i];
+            break;
+        case STREAM_TRIAD:
+            for (int i=range->start ; i<range->end ; i++) stream_a[i] = stream_b[i] + scalar*stream_c[i];
+            break;
+        }
+
+        pthread_barrier_wait(&stream_end);
+    }
+}
+
+// Measures the best bandwidth of each kernel in GB/s with the given number of
+// threads and stores them in bandwidths
+static void measureBandwidth(int threads, double* bandwidths) {
+    pthread_t stream_threads[threads];
+    STREAM_THREAD ranges[threads];
+
+    pthread_barrier_init(&stream_start, NULL, threads+1);
+    pthread_barrier_init(&stream_end, NULL, threads+1);
+    stream_finished = 0;
+
+    for (int i=0 ; i<threads ; i++) {
+        ranges[i].start = (long long)STREAM_ARRAY_LENGTH*i/threads;
+        ranges[i].end = (long long)STREAM_ARRAY_LENGTH*(i+1)/threads;
+        pthread_create(&stream_threads[i], NULL, initStreamThread, &ranges[i]);
+    }
+
+    for (int k=0 ; k<STREAM_KERNEL_COUNT ; k++) {
+        bandwidths[k] = 0;
+    }
+
+    for (int repetition=0 ; repetition<STREAM_REPETITIONS ; repetition++) {
+        for (int k=0 ; k<STREAM_KERNEL_COUNT ; k++) {
+            stream_kernel = k;
+            long long start = getMonotonicNanoseconds();
+            pthread_barrier_wait(&stream_start);
+            pthread_barrier_wait(&stream_end);
+            long long end = getMonotonicNanoseconds();
+
+            double bandwidth = (double)stream_kernel_bytes[k]*STREAM_ARRAY_LENGTH/(end - start);
+            if (bandwidth > bandwidths[k]) {
+                bandwidths[k] = bandwidth;
+            }
+        }
+    }
+
+    stream_finished = 1;
+    pthread_barrier_wait(&stream_start);
+    for (int i=0 ; i<threads ; i++) {
+        pthread_join(stream_threads[i], NULL);
+    }
+    pthread_barrier_destroy(&stream_start);
+    pthread_barrier_destroy(&stream_end);
+}
+
+// Measures the bandwidth with 1 to max_threads threads, prints it and caches it
+// for this host, replacing any earlier calibration of the host once every
+// measurement is done so that a failed one leaves the cache as it was. Returns
+// 0 on success and 1 if the arrays can't be allocated or the cache written
+int calibrateBandwidth(int max_threads) {
+    if (max_threads < 1) {
+        printf("There must be at least 1 thread\n");
+        return 1;
+    }
+    char host[256];
+    gethostname(host, sizeof(host));
+
+    double (*bandwidths)[STREAM_KERNEL_COUNT] = malloc(max_threads*sizeof(*bandwidths));
+    stream_a = malloc(STREAM_ARRAY_LENGTH*sizeof(double));
+    stream_b = malloc(STREAM_ARRAY_LENGTH*sizeof(double));
+    stream_c = malloc(STREAM_ARRAY_LENGTH*sizeof(double));
+    if (bandwidths == NULL || stream_a == NULL || stream_b == NULL || stream_c == NULL) {
+        printf("Could not allocate the calibration arrays\n");
+        free(bandwidths);
+        free(stream_a);
+        free(stream_b);
+        free(stream_c);
+        return 1;
+    }
+    printf("threads, %s GB/s, %s GB/s, %s GB/s, %s GB/s\n", stream_kernel_names[0], stream_kernel_names[1],
+            stream_kernel_names[2], stream_kernel_names[3]);
+    for (int threads=1 ; threads<=max_threads ; threads++) {
+        double* measured = bandwidths[threads-1];
+        measureBandwidth(threads, measured);
+        printf("%d, %f, %f, %f, %f\n", threads, measured[0], measured[1], measured[2], measured[3]);
+    }
+    free(stream_a);
+    free(stream_b);
+    free(stream_c);
+
+    // keep the calibrations of other hosts
+    const char* cache_file = getCacheFile();
+    char* kept = calloc(1, 1);
+    size_t kept_length = 0;
+    FILE* file = fopen(cache_file, "r");
+    if (file != NULL) {
+        char line[512], line_host[256];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            if (sscanf(line, "%255s", line_host) == 1 && strcmp(line_host, host) != 0) {
+                kept = realloc(kept, kept_length + strlen(line) + 1);
+                strcpy(&kept[kept_length], line);
+                kept_length += strlen(line);
+            }
+        }
+        fclose(file);
+    }
+
+    file = fopen(cache_file, "w");
+    if (file == NULL) {
+        printf("Could not write '%s'\n", cache_file);
+        free(kept);
+        free(bandwidths);
+        return 1;
+    }
+    fputs(kept, file);
+    free(kept);
+    for (int threads=1 ; threads<=max_threads ; threads++) {
+        double* measured = bandwidths[threads-1];
+        fprintf(file, "%s %d %f %f %f %f\n", host, threads, measured[0], measured[1], measured[2], measured[3]);
+    }
+    free(bandwidths);
+
+    if (fclose(file) != 0) {
+        printf("Could not write '%s'\n", cache_file);
+        return 1;
+    }
+    return 0;
+}
+
+// Returns the cached triad bandwidth in GB/s of this host with the given number
+// of threads, or with the most threads calibrated below it, or 0 if this host
+// hasn't been calibrated
+double getAttainableBandwidth(int threads) {
+    char host[256];
+    gethostname(host, sizeof(host));
+
+    FILE* file = fopen(getCacheFile(), "r");
+    if (file == NULL) {
+        return 0;
+    }
+
+    double attainable = 0;
+    int best_threads = 0;
+    char line[512], line_host[256];
+    int line_threads;
+    double bandwidths[STREAM_KERNEL_COUNT];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "%255s %d %lf %lf %lf %lf", line_host, &line_threads, &bandwidths[0], &bandwidths[1],
+                &bandwidths[2], &bandwidths[3]) != 6 || strcmp(line_host, host) != 0) {
+            continue;
+        }
+        if (line_threads <= threads && line_threads > best_threads) {
+            best_threads = line_threads;
+            attainable = bandwidths[STREAM_TRIAD];
+        }
+    }
+
+    fclose(file);
+    return attainable;
+}
+
+// Prints the bytes each sweep moves and the share of the attainable bandwidth
+// the given number of sweeps in the given time achieved to stderr, against the
+// bandwidth of as many threads as the backend runs, which is 1 for the
+// sequential backend
+void printRoofline(double time_taken, long long iterations) {
+    int threads = backend == BACKEND_SEQUENTIAL ? 1 : thread_count;
+    double bytes_per_sweep = (double)getSweepCells()*getBytesPerCell();
+    double achieved = time_taken > 0 ? bytes_per_sweep*iterations/time_taken*1e-9 : 0;
+    double attainable = getAttainableBandwidth(threads);
+
+    if (attainable > 0) {
+        fprintf(stderr, "bytes per sweep, sweeps, achieved GB/s, attainable GB/s, percent of attainable\n");
+        fprintf(stderr, "%.0f, %lld, %f, %f, %.1f%%\n", bytes_per_sweep, iterations, achieved, attainable,
+                achieved/attainable*100);
+    } else {
+        fprintf(stderr, "bytes per sweep, sweeps, achieved GB/s\n");
+        fprintf(stderr, "%.0f, %lld, %f (run with -B %d to calibrate the attainable bandwidth)\n",
+                bytes_per_sweep, iterations, achieved, threads);
+    }
+}
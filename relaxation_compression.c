@@ -0,0 +1,244 @@
+/**
+* Compressed grid files
+* Oliver Redeyoff
+*
+* Grids written to a file ending in .rlx are stored in bands of rows which are
+* each compressed on their own, so that they can be compressed and
+* decompressed in parallel and any band can be read without the others:
+*
+*   GRID_HEADER | GRID_BAND entry per band | compressed bands, in order
+*
+* Each value is predicted from its neighbours which come before it, with the
+* left neighbour plus the one above minus the one above-left when both rows are
+* in the band, which is exact for planes and close for any smooth field, or the
+* left or above neighbour alone on the band's edges. Only the difference to the
+* prediction is stored:
+*
+* - losslessly, as the bits of the value XORed with the bits of the prediction,
+*   in which a close prediction leaves the high bytes zero
+* - quantised to a multiple of the quantum (with -q, the solve's precision), as
+*   the difference of the multiples, which only loses what the solve doesn't
+*   resolve anyway and leaves even more zero bytes
+*
+* The differences are stored two at a time behind a byte holding how many low
+* bytes of each are kept, and the zero high bytes are dropped.
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "relaxation_technique.h"
+
+// read by the decompression tasks
+static int load_file;
+static GRID_HEADER load_header;
+static GRID_BAND* load_bands;
+static double* load_values;
+static atomic_int load_failed;
+
+// Returns the number of low bytes needed to hold residual
+static inline int getSignificantBytes(unsigned long long residual) {
+    int bytes = 0;
+    while (residual != 0) {
+        residual >>= 8;
+        bytes++;
+    }
+    return bytes;
+}
+
+// Returns the prediction of value index of a band of rows width values wide
+// from the values before it, which are doubles or quantised multiples
+#define PREDICT(values, index, width) \
+    ((index) >= (width) && (index)%(width) != 0 ? \
+            (values)[(index)-1] + (values)[(index)-(width)] - (values)[(index)-(width)-1] : \
+     (index)%(width) != 0 ? (values)[(index)-1] : \
+     (index) >= (width) ? (values)[(index)-(width)] : 0)
+
+// Returns the most bytes compressBand() can write for count values
+size_t getCompressedBandCapacity(long long count) {
+    return count*sizeof(double) + (count+1)/2;
+}
+
+// Compresses count values of a band of rows width values wide into out, quantised
+// to multiples of quantum unless it is 0, and returns the number of bytes written
+size_t compressBand(const double* values, long long count, int width, double quantum, unsigned char* out) {
+    unsigned char* end = out;
+    unsigned char* counts = NULL;
+    long long* multiples = NULL;
+
+    if (quantum > 0) {
+        multiples = malloc(count*sizeof(long long));
+        for (long long i=0 ; i<count ; i++) {
+            multiples[i] = llround(values[i]/quantum);
+        }
+    }
+
+    for (long long i=0 ; i<count ; i++) {
+        unsigned long long residual;
+        if (quantum > 0) {
+            // zigzag the difference so that small negative ones stay small
+            long long difference = multiples[i] - PREDICT(multiples, i, width);
+            residual = ((unsigned long long)difference << 1) ^ (unsigned long long)(difference >> 63);
+        } else {
+            double prediction = PREDICT(values, i, width);
+            unsigned long long value_bits, prediction_bits;
+            memcpy(&value_bits, &values[i], sizeof(double));
+            memcpy(&prediction_bits, &prediction, sizeof(double));
+            residual = value_bits ^ prediction_bits;
+        }
+
+        int bytes = getSignificantBytes(residual);
+        if (i%2 == 0) {
+            counts = end++;
+            *counts = bytes;
+        } else {
+            *counts |= bytes << 4;
+        }
+        for (int b=0 ; b<bytes ; b++) {
+            *end++ = residual >> (8*b);
+        }
+    }
+
+    free(multiples);
+    return end - out;
+}
+
+// Decompresses count values of a band of rows width values wide from the length
+// bytes in into values, and returns 0, or 1 if the bytes are not a valid band
+int decompressBand(const unsigned char* in, size_t length, long long count, int width, double quantum,
+        double* values) {
+    const unsigned char* end = in + length;
+    long long* multiples = quantum > 0 ? malloc(count*sizeof(long long)) : NULL;
+    int counts = 0;
+
+    for (long long i=0 ; i<count ; i++) {
+        if (i%2 == 0) {
+            if (in >= end) {
+                free(multiples);
+                return 1;
+            }
+            counts = *in++;
+        }
+        int bytes = i%2 == 0 ? counts & 15 : counts >> 4;
+        if (bytes > 8 || in + bytes > end) {
+            free(multiples);
+            return 1;
+        }
+
+        unsigned long long residual = 0;
+        for (int b=0 ; b<bytes ; b++) {
+            residual |= (unsigned long long)*in++ << (8*b);
+        }
+
+        if (quantum > 0) {
+            long long difference = (long long)(residual >> 1) ^ -(long long)(residual & 1);
+            multiples[i] = PREDICT(multiples, i, width) + difference;
+            values[i] = multiples[i]*quantum;
+        } else {
+            double prediction = PREDICT(values, i, width);
+            unsigned long long prediction_bits;
+            memcpy(&prediction_bits, &prediction, sizeof(double));
+            prediction_bits ^= residual;
+            memcpy(&values[i], &prediction_bits, sizeof(double));
+        }
+    }
+
+    free(multiples);
+    return in != end;
+}
+
+// Reads the given band of the open compressed grid file into its rows of
+// values, as a task on the worker pool, and flags the load as failed if it
+// can't be read
+static void loadBand(int band, void* argument) {
+    long long first_row = (long long)band*load_header.band_rows;
+    long long row_count = load_header.rows - first_row < load_header.band_rows ?
+            load_header.rows - first_row : load_header.band_rows;
+    unsigned char* compressed = malloc(load_bands[band].length);
+    double* band_values = malloc(row_count*load_header.width*sizeof(double));
+
+    int failed = pread(load_file, compressed, load_bands[band].length, load_bands[band].offset) != load_bands[band].length ||
+            decompressBand(compressed, load_bands[band].length, row_count*load_header.width, load_header.width,
+                    load_header.quantum, band_values);
+
+    // the bands hold rows without their padding
+    if (!failed) {
+        for (long long i=0 ; i<row_count ; i++) {
+            memcpy(&load_values[(first_row+i)*row_stride], &band_values[i*load_header.width],
+                    load_header.width*sizeof(double));
+        }
+    }
+
+    free(compressed);
+    free(band_values);
+    if (failed) {
+        atomic_store(&load_failed, 1);
+    }
+}
+
+// Returns 1 if the file with the given name is a compressed grid file
+int isCompressedGrid(char* file_name) {
+    char magic[sizeof(GRID_MAGIC)-1];
+    FILE* file = fopen(file_name, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    int compressed = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+            memcmp(magic, GRID_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+    return compressed;
+}
+
+// Returns the grid of rows rows of matrix_width values, row_stride apart, in the
+// compressed grid file with the given name, decompressed on the worker pool, or
+// NULL if it can't be read or holds a grid of another size
+double* loadCompressedGrid(char* file_name, long long rows) {
+    load_file = open(file_name, O_RDONLY);
+    if (load_file == -1 || pread(load_file, &load_header, sizeof(GRID_HEADER), 0) != sizeof(GRID_HEADER) ||
+            load_header.version != GRID_VERSION) {
+        printf("Could not read '%s'\n", file_name);
+        if (load_file != -1) {
+            close(load_file);
+        }
+        return NULL;
+    }
+    if (load_header.width != matrix_width || load_header.rows != rows) {
+        printf("'%s' holds a grid of %lld rows of %d values, not %lld rows of %d\n", file_name,
+                load_header.rows, load_header.width, rows, matrix_width);
+        close(load_file);
+        return NULL;
+    }
+    // every row must belong to exactly one band
+    if (load_header.band_rows <= 0 ||
+            load_header.band_count != (rows + load_header.band_rows - 1)/load_header.band_rows) {
+        printf("'%s' is damaged\n", file_name);
+        close(load_file);
+        return NULL;
+    }
+
+    load_bands = malloc(load_header.band_count*sizeof(GRID_BAND));
+    load_values = makeGrid(rows);
+    size_t index_size = load_header.band_count*sizeof(GRID_BAND);
+    int failed = pread(load_file, load_bands, index_size, sizeof(GRID_HEADER)) != index_size;
+
+    if (!failed) {
+        atomic_init(&load_failed, 0);
+        runParallelFor(load_header.band_count, loadBand, NULL);
+        failed = atomic_load(&load_failed);
+    }
+
+    close(load_file);
+    free(load_bands);
+    if (failed) {
+        printf("'%s' is damaged\n", file_name);
+        free(load_values);
+        return NULL;
+    }
+    return load_values;
+}
@@ -0,0 +1,136 @@
+/**
+* In place Jacobi relaxation
+* Oliver Redeyoff
+*
+* Gives the same results as relaxing into the blocks' new_values and copying
+* them back in the update step, but writes the new values straight back into
+* matrix so that no second copy of the matrix is needed.
+*
+* A thread relaxing a row needs the old values of the rows either side of it.
+* Within its block it keeps the new values of the last two rows it relaxed in a
+* pair of rolling row buffers and only writes a row back once the row after it
+* has been relaxed, so the old values of the row above are still in matrix when
+* they are read. The rows either side of a block belong to the neighbouring
+* blocks, which may already have written them back, so every block also keeps
+* copies of its first and last rows as they were at the end of the previous
+* iteration for its neighbours to read. These are double buffered by the parity
+* of the iteration so a block can write the next copies while its neighbours are
+* still reading the current ones.
+*
+**/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "relaxation_technique.h"
+
+// the number of iterations finished, whose parity picks the edge row copies to read
+static int iteration;
+
+// Allocates the given block's rolling row buffers and its copies of its first and
+// last rows, and fills the copies for the first iteration from matrix
+void makeInPlaceBuffers(BLOCK* block) {
+    size_t row_bytes = matrix_width*sizeof(double);
+
+    block->new_values = NULL;
+    block->row_buffers = makeGrid(2);
+    block->edge_rows = makeGrid(4);
+
+    if (block->end_row >= block->start_row) {
+        memcpy(getEdgeRow(block, 0, 0), &matrix[block->start_row*row_stride], row_bytes);
+        memcpy(getEdgeRow(block, 0, 1), &matrix[block->end_row*row_stride], row_bytes);
+    }
+    iteration = 0;
+}
+
+// Returns the copy of the given block's first (last == 0) or last (last == 1) row
+// kept for the iterations with the given parity
+double* getEdgeRow(BLOCK* block, int parity, int last) {
+    return &block->edge_rows[(2*parity + last)*row_stride];
+}
+
+// Relaxes one row with the kernel for the problem being solved
+static int relaxInPlaceRow(int row, const double* up, const double* current_row, const double* down, double* out) {
+    if (source == NULL) {
+        return row_kernel(up, current_row, down, out, matrix_width, decimal_value);
+    }
+
+    const double* coefficient_row = coefficients != NULL ? &coefficients[row*row_stride] : NULL;
+    return poisson_row_kernel(up, current_row, down, &source[row*row_stride],
+            coefficient_row != NULL ? coefficient_row - row_stride : NULL,
+            coefficient_row,
+            coefficient_row != NULL ? coefficient_row + row_stride : NULL,
+            out, matrix_width, spacing_squared, decimal_value);
+}
+
+// Performs relaxation for the rows of matrix defined in the given block, writing
+// the results straight back to matrix
+void processInPlaceBlock(BLOCK* block) {
+    if (block->end_row < block->start_row) {
+        return;
+    }
+
+    int parity = iteration%2;
+    int block_index = block - blocks;
+    size_t interior_bytes = (matrix_width-2)*sizeof(double);
+    int changed = 0;
+
+    // the old rows either side of the block, which are edges of matrix or copies
+    // kept by the neighbouring blocks
+    const double* above = &matrix[(block->start_row-1)*row_stride];
+    if (block->start_row > 1) {
+        above = getEdgeRow(&blocks[block_index-1], parity, 1);
+    }
+    const double* below = &matrix[(block->end_row+1)*row_stride];
+    if (block->end_row < matrix_height-2) {
+        below = getEdgeRow(&blocks[block_index+1], parity, 0);
+    }
+
+    for (int row=block->start_row ; row<=block->end_row ; row++) {
+        double* current_row = &matrix[row*row_stride];
+        double* new_row = &block->row_buffers[(row%2)*row_stride];
+
+        // the row above is only written back after this row has been relaxed
+        const double* up = row == block->start_row ? above : current_row - row_stride;
+        const double* down = row == block->end_row ? below : current_row + row_stride;
+        changed |= relaxInPlaceRow(row, up, current_row, down, new_row);
+
+        if (row > block->start_row) {
+            memcpy(&current_row[1 - row_stride], &block->row_buffers[((row-1)%2)*row_stride + 1], interior_bytes);
+        }
+    }
+    memcpy(&matrix[block->end_row*row_stride + 1], &block->row_buffers[(block->end_row%2)*row_stride + 1], interior_bytes);
+
+    // keep copies of the new first and last rows for the neighbours' next iteration
+    size_t row_bytes = matrix_width*sizeof(double);
+    memcpy(getEdgeRow(block, 1-parity, 0), &matrix[block->start_row*row_stride], row_bytes);
+    memcpy(getEdgeRow(block, 1-parity, 1), &matrix[block->end_row*row_stride], row_bytes);
+
+    if (changed) {
+        value_change_flag = 1;
+    }
+}
+
+// Moves on to the next iteration, as the new values are already in matrix, and
+// brings any Neumann sides, and the ends of the edge row copies which lie on
+// them, in line with them
+void updateInPlace() {
+    iteration++;
+
+    if (hasNeumannBoundaries()) {
+        applyNeumannBoundaries();
+
+        int parity = iteration%2;
+        for (int i=0 ; i<thread_count ; i++) {
+            if (blocks[i].end_row < blocks[i].start_row) {
+                continue;
+            }
+            for (int last=0 ; last<2 ; last++) {
+                int row = last ? blocks[i].end_row : blocks[i].start_row;
+                double* edge_row = getEdgeRow(&blocks[i], parity, last);
+                edge_row[0] = matrix[row*row_stride];
+                edge_row[matrix_width-1] = matrix[row*row_stride + matrix_width-1];
+            }
+        }
+    }
+}
@@ -0,0 +1,77 @@
+/**
+* Per thread instrumentation
+* Oliver Redeyoff
+*
+* Only compiled in when RELAXATION_INSTRUMENT is defined (make instrumented).
+* Every worker thread keeps its own counters of the time it spends relaxing and
+* updating its block, the time it spends waiting at barriers, the cells it
+* updates and the iterations it runs, and the main thread keeps the time it
+* spends in the sequential step. Counters are only ever written by their own
+* thread and sit on their own cache lines, so counting costs a couple of reads
+* of the monotonic clock per phase and no synchronisation. They are summed up
+* into load imbalance and synchronisation overhead figures once the solve ends.
+*
+**/
+
+
+#include "relaxation_technique.h"
+
+#ifdef RELAXATION_INSTRUMENT
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// counters of each worker thread, followed by those of the main thread
+WORKER_COUNTERS* worker_counters;
+
+// Allocates zeroed counters for every worker thread and the main thread
+void makeWorkerCounters() {
+    worker_counters = makeCacheAligned(thread_count+1, sizeof(WORKER_COUNTERS));
+}
+
+// Returns the number of cells the given block updates each iteration
+long long getBlockCells(BLOCK* block) {
+    long long rows = block->end_row - block->start_row + 1;
+    long long planes = block->end_plane - block->start_plane + 1;
+    if (rows <= 0 || planes <= 0) {
+        return 0;
+    }
+    return planes*rows*(matrix_width-2);
+}
+
+// Prints each worker thread's counters and the load imbalance and synchronisation
+// overhead they add up to to stderr, so the timing line on stdout is unchanged
+void printWorkerCounters() {
+    double total_compute = 0;
+    double max_compute = 0;
+    double total_wait = 0;
+
+    fprintf(stderr, "thread, compute, barrier wait, cells updated, iterations, cells per second\n");
+    for (int i=0 ; i<thread_count ; i++) {
+        WORKER_COUNTERS* counters = &worker_counters[i];
+        double compute = counters->compute_nanoseconds*1e-9;
+        double wait = counters->wait_nanoseconds*1e-9;
+
+        fprintf(stderr, "%d, %f, %f, %lld, %lld, %.0f\n", i, compute, wait,
+                counters->cells_updated, counters->iterations,
+                compute > 0 ? counters->cells_updated/compute : 0.0);
+
+        total_compute += compute;
+        total_wait += wait;
+        if (compute > max_compute) {
+            max_compute = compute;
+        }
+    }
+
+    // the slowest thread holds every other one up at each barrier, so imbalance
+    // is how much longer it computes for than the average thread
+    double mean_compute = total_compute/thread_count;
+    double imbalance = mean_compute > 0 ? (max_compute/mean_compute - 1)*100 : 0;
+    double overhead = total_compute + total_wait > 0 ? total_wait/(total_compute + total_wait)*100 : 0;
+
+    fprintf(stderr, "main thread sequential step: %f\n", worker_counters[thread_count].compute_nanoseconds*1e-9);
+    fprintf(stderr, "load imbalance: %.1f%%\n", imbalance);
+    fprintf(stderr, "synchronisation overhead: %.1f%%\n", overhead);
+}
+
+#endif
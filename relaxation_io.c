@@ -0,0 +1,268 @@
+/**
+* Reading and writing matrices
+* Oliver Redeyoff
+*
+* Matrices are read and written as text, a row of space separated values per
+* line, in the format loadGrid() reads for -f, -r and -c, so that the output of
+* one solve can be the input of the next. Volumes are written plane by plane
+* with an empty line between planes. Values are written with 17 significant
+* digits so that they read back exactly. Only the matrix_width values of each
+* row are written, not the padding up to row_stride which follows them.
+*
+* Output runs in the background once the solve has ended, so that it overlaps
+* with reporting and cleaning up instead of adding to them: startOutput() splits
+* the rows into bands of OUTPUT_BAND_ROWS rows, the worker pool's threads each
+* take the next band to format into a buffer of their own, and a writer thread
+* writes the buffers to the file in order as they are finished. At most
+* OUTPUT_WINDOW bands are held at once, so memory use doesn't grow with the
+* grid. finishOutput() waits for the file to be complete. Checkpoints are
+* written while the solve holds the pool, so they get formatting threads of
+* their own, one per worker thread.
+*
+* Files ending in .rlx are written in the compressed format instead (see
+* relaxation_compression.c), with the bands compressed by the same threads and
+* the index of where each band went written once they all have been.
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "relaxation_technique.h"
+
+// rows formatted together, and the most bands formatted ahead of the writer
+#define OUTPUT_BAND_ROWS 64
+#define OUTPUT_WINDOW 64
+
+// longest formatted value, such as -2.2250738585072014e-308, and its separator
+#define OUTPUT_VALUE_CHARACTERS 25
+
+typedef struct output_band {
+    char* text;
+    size_t length;
+    int formatted;
+} OUTPUT_BAND;
+
+// quantise compressed output to the solve's precision
+int quantise_output;
+
+static FILE* output;
+static int output_compressed;
+static GRID_HEADER output_header;
+static GRID_BAND* output_index;
+static double* output_values;
+static long long output_rows;
+static int output_band_count;
+static OUTPUT_BAND* output_bands;
+static int output_thread_count;
+static pthread_t* output_threads;
+static pthread_t writer_thread;
+static int output_pooled;
+
+// next band to format and next band to write, shared under output_lock
+static int next_band;
+static int written_bands;
+static int output_failed;
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t output_changed = PTHREAD_COND_INITIALIZER;
+
+// Formats rows first_row to first_row+row_count-1 of the grid into text and
+// returns the number of characters written, starting each plane after the first
+// with an empty line
+static size_t formatRows(long long first_row, int row_count, char* text) {
+    char* end = text;
+
+    for (long long row=first_row ; row<first_row+row_count ; row++) {
+        if (dimensions == 3 && row > 0 && row%matrix_size == 0) {
+            *end++ = '\n';
+        }
+        double* values = &output_values[row*row_stride];
+        for (int j=0 ; j<matrix_width ; j++) {
+            end += sprintf(end, j < matrix_width-1 ? "%.17g " : "%.17g\n", values[j]);
+        }
+    }
+
+    return end - text;
+}
+
+// Entry point for the formatting threads, which format the next band that
+// hasn't been taken yet, as long as it is within the window of the writer
+static void* initFormatThread(void* vargp) {
+    while (1) {
+        pthread_mutex_lock(&output_lock);
+        while (next_band < output_band_count && next_band >= written_bands + OUTPUT_WINDOW) {
+            pthread_cond_wait(&output_changed, &output_lock);
+        }
+        int band = next_band++;
+        pthread_mutex_unlock(&output_lock);
+
+        if (band >= output_band_count) {
+            return NULL;
+        }
+
+        long long first_row = (long long)band*OUTPUT_BAND_ROWS;
+        int row_count = output_rows - first_row < OUTPUT_BAND_ROWS ? output_rows - first_row : OUTPUT_BAND_ROWS;
+        char* text;
+        size_t length;
+        if (output_compressed) {
+            // the band's rows are compressed without their padding
+            long long count = (long long)row_count*matrix_width;
+            double* band_values = malloc(count*sizeof(double));
+            for (int i=0 ; i<row_count ; i++) {
+                memcpy(&band_values[(long long)i*matrix_width], &output_values[(first_row+i)*row_stride],
+                        matrix_width*sizeof(double));
+            }
+            text = malloc(getCompressedBandCapacity(count));
+            length = compressBand(band_values, count, matrix_width, output_header.quantum, (unsigned char*)text);
+            free(band_values);
+        } else {
+            text = malloc((size_t)row_count*(matrix_width*OUTPUT_VALUE_CHARACTERS + 1) + 1);
+            length = formatRows(first_row, row_count, text);
+        }
+
+        pthread_mutex_lock(&output_lock);
+        output_bands[band].text = text;
+        output_bands[band].length = length;
+        output_bands[band].formatted = 1;
+        pthread_cond_broadcast(&output_changed);
+        pthread_mutex_unlock(&output_lock);
+    }
+}
+
+// Formats bands as a phase of the worker pool
+static void runFormatWorker(int worker) {
+    initFormatThread(NULL);
+}
+
+// Entry point for the writer thread, which writes the bands in order as soon as
+// each one has been formatted
+static void* initWriterThread(void* vargp) {
+    long long offset = sizeof(GRID_HEADER) + output_band_count*sizeof(GRID_BAND);
+
+    for (int band=0 ; band<output_band_count ; band++) {
+        pthread_mutex_lock(&output_lock);
+        while (!output_bands[band].formatted) {
+            pthread_cond_wait(&output_changed, &output_lock);
+        }
+        pthread_mutex_unlock(&output_lock);
+
+        if (fwrite(output_bands[band].text, 1, output_bands[band].length, output) != output_bands[band].length) {
+            output_failed = 1;
+        }
+        free(output_bands[band].text);
+        if (output_compressed) {
+            output_index[band].offset = offset;
+            output_index[band].length = output_bands[band].length;
+            offset += output_bands[band].length;
+        }
+
+        pthread_mutex_lock(&output_lock);
+        written_bands = band + 1;
+        pthread_cond_broadcast(&output_changed);
+        pthread_mutex_unlock(&output_lock);
+    }
+
+    return NULL;
+}
+
+// Starts writing the given grid, matrix_height rows of row_stride values or
+// matrix_size^3 values when solving in 3 dimensions, to the given file in the
+// background and returns 0, or returns 1 if the file can't be opened. Compressed
+// output is quantised to multiples of quantum unless it is 0. The grid must not
+// change until finishOutput() returns
+int startOutput(char* file_name, double* values, double quantum) {
+    output = fopen(file_name, "w");
+    if (output == NULL) {
+        printf("Could not write '%s'\n", file_name);
+        return 1;
+    }
+
+    output_values = values;
+    output_rows = dimensions == 3 ? (long long)matrix_size*matrix_size : matrix_height;
+    output_band_count = (output_rows + OUTPUT_BAND_ROWS - 1)/OUTPUT_BAND_ROWS;
+    output_bands = calloc(output_band_count, sizeof(OUTPUT_BAND));
+    next_band = 0;
+    written_bands = 0;
+    output_failed = 0;
+
+    // the compressed format starts with its header and room for the index
+    size_t length = strlen(file_name);
+    output_compressed = length > 4 && strcmp(&file_name[length-4], ".rlx") == 0;
+    if (output_compressed) {
+        memset(&output_header, 0, sizeof(GRID_HEADER));
+        memcpy(output_header.magic, GRID_MAGIC, sizeof(output_header.magic));
+        output_header.version = GRID_VERSION;
+        output_header.width = matrix_width;
+        output_header.band_rows = OUTPUT_BAND_ROWS;
+        output_header.rows = output_rows;
+        output_header.band_count = output_band_count;
+        output_header.quantum = quantum;
+        output_index = calloc(output_band_count, sizeof(GRID_BAND));
+        fwrite(&output_header, sizeof(GRID_HEADER), 1, output);
+        fwrite(output_index, sizeof(GRID_BAND), output_band_count, output);
+    }
+
+    // format on the pool, or on a thread per worker thread if it is in use
+    output_pooled = startPoolPhase(runFormatWorker) == 0;
+    output_thread_count = output_pooled ? 0 : thread_count > 0 ? thread_count : 1;
+    output_threads = malloc((output_thread_count > 0 ? output_thread_count : 1)*sizeof(pthread_t));
+    for (int i=0 ; i<output_thread_count ; i++) {
+        pthread_create(&output_threads[i], NULL, initFormatThread, NULL);
+    }
+    pthread_create(&writer_thread, NULL, initWriterThread, NULL);
+
+    return 0;
+}
+
+// Waits for the output started by startOutput() to be written and returns 0, or
+// returns 1 if it couldn't be written
+int finishOutput() {
+    pthread_join(writer_thread, NULL);
+    if (output_pooled) {
+        finishPoolPhase();
+    }
+    for (int i=0 ; i<output_thread_count ; i++) {
+        pthread_join(output_threads[i], NULL);
+    }
+    free(output_threads);
+    free(output_bands);
+
+    // fill in the index now that every band's place is known
+    if (output_compressed) {
+        if (fseek(output, sizeof(GRID_HEADER), SEEK_SET) != 0 ||
+                fwrite(output_index, sizeof(GRID_BAND), output_band_count, output) != output_band_count) {
+            output_failed = 1;
+        }
+        free(output_index);
+    }
+
+    if (fclose(output) != 0) {
+        output_failed = 1;
+    }
+    if (output_failed) {
+        printf("Could not write the output\n");
+    }
+    return output_failed;
+}
+
+// Writes the given grid to the given file, through a temporary file which then
+// replaces it, so that the file always holds a whole grid, and returns 0, or
+// returns 1 if it couldn't be written. The grid is always written losslessly,
+// as it is a checkpoint the solve may be resumed from
+int writeGrid(char* file_name, double* values) {
+    char temporary_name[strlen(file_name) + 5];
+    sprintf(temporary_name, "%s.tmp", file_name);
+
+    // keep the extension, which picks the format
+    size_t length = strlen(file_name);
+    if (length > 4 && strcmp(&file_name[length-4], ".rlx") == 0) {
+        sprintf(temporary_name, "%.*s.tmp.rlx", (int)(length-4), file_name);
+    }
+
+    if (startOutput(temporary_name, values, 0) || finishOutput()) {
+        return 1;
+    }
+    return rename(temporary_name, file_name) != 0;
+}
@@ -0,0 +1,311 @@
+/**
+* Solve jobs
+* Oliver Redeyoff
+*
+* startJob() runs the solve set up by main() with the selected backend on a
+* thread of its own, so that the caller can poll its progress, cancel it or take
+* snapshots of the grid while it runs, and waitForJob() collects its results.
+*
+* Requests are serviced by the backend's main thread through serviceJob() once
+* per iteration, at the point where the grid holds a complete iterate: during
+* the update phase, or after the block update step when there is one, while the
+* worker threads only read the grid. Nothing is copied unless it was asked for.
+*
+* The residual, the largest change of a cell in one iteration, is not tracked
+* by the kernels, so polling the progress asks for it to be measured: the grid
+* is copied at one iteration and compared with the next. The convergence rate
+* between the last two measurements gives the number of iterations left until
+* the residual falls below the precision, and so the estimated time left.
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "relaxation_technique.h"
+
+static pthread_t job_thread;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_changed = PTHREAD_COND_INITIALIZER;
+static int job_state;
+static long long job_start;
+static atomic_llong job_iterations;
+static atomic_int job_cancelled;
+
+// results of the backend once the job has ended
+static double job_sequential_time_taken;
+static double job_parallel_time_taken;
+
+// a snapshot is copied into snapshot by the backend when snapshot_requested is set
+static atomic_int snapshot_requested;
+static double* snapshot;
+static int snapshot_taken;
+
+// a residual measurement starts when residual_requested is set by copying the
+// grid into residual_grid at residual_iteration, and ends at the next iteration.
+// residual_grid is only allocated for the first measurement, as most solves are
+// never polled
+static atomic_int residual_requested;
+static double* residual_grid;
+static long long residual_iteration = -1;
+
+// the last two residuals measured and the iterations they were measured at
+static double residuals[2];
+static long long residual_iterations[2];
+static int residual_count;
+
+// Returns the number of cells in the grid being solved, which for the MPI
+// backend is this rank's rows and their halo rows
+static long long getGridCells() {
+    if (dimensions == 3) {
+        return (long long)matrix_size*matrix_size*matrix_size;
+    }
+    return (long long)(owned_rows+2)*row_stride;
+}
+
+// Returns the grid holding the current iterate
+static double* getGrid() {
+    return dimensions == 3 ? volume : matrix;
+}
+
+// Returns the largest change of a cell of the given row of the grid given as
+// argument since the residual measurement started
+static double getRowChange(int row, void* argument) {
+    double* grid = argument;
+    double change = 0;
+
+    for (long long i=(long long)row*row_stride ; i<(long long)row*row_stride + matrix_width ; i++) {
+        double cell_change = fabs(grid[i] - residual_grid[i]);
+        if (cell_change > change) {
+            change = cell_change;
+        }
+    }
+    return change;
+}
+
+// Entry point for the job thread, which runs the selected backend
+static void* runJob(void* vargp) {
+    // the counters of thread 0 only count the thread which opens them, and the
+    // backend's main thread is this one
+    if (perf_enabled && !isCountingHardware(0)) {
+        startHardwareCounters(0);
+    }
+
+    double sequential_time_taken = 0;
+    double parallel_time_taken = 0;
+    long long iterations = solveWithBackend(&sequential_time_taken, &parallel_time_taken);
+
+    pthread_mutex_lock(&job_lock);
+    atomic_store(&job_iterations, iterations);
+    job_sequential_time_taken = sequential_time_taken;
+    job_parallel_time_taken = parallel_time_taken;
+    job_state = atomic_load(&job_cancelled) ? JOB_CANCELLED : JOB_CONVERGED;
+    pthread_cond_broadcast(&job_changed);
+    pthread_mutex_unlock(&job_lock);
+
+    return NULL;
+}
+
+// Starts solving the problem set up in the global state on a new thread and
+// returns 0, or returns 1 if the thread can't be created
+int startJob() {
+    job_state = JOB_RUNNING;
+    job_start = getMonotonicNanoseconds();
+    atomic_init(&job_iterations, 0);
+    atomic_init(&job_cancelled, 0);
+    atomic_init(&snapshot_requested, 0);
+    atomic_init(&residual_requested, 0);
+
+    if (pthread_create(&job_thread, NULL, runJob, NULL) != 0) {
+        job_state = JOB_CANCELLED;
+        return 1;
+    }
+    return 0;
+}
+
+// Called by the backend's main thread once per iteration, when the grid holds a
+// complete iterate, to record the iteration and serve any pending requests
+void serviceJob(long long iterations) {
+    atomic_store(&job_iterations, iterations);
+    if (residual_iteration == -1 && !atomic_load(&residual_requested) && !atomic_load(&snapshot_requested)) {
+        return;
+    }
+
+    pthread_mutex_lock(&job_lock);
+    double* grid = getGrid();
+    long long cells = getGridCells();
+
+    if (residual_iteration != -1) {
+        // finish the measurement started at the last iteration, on the pool
+        // when the backend isn't running its worker threads on it
+        double residual = runParallelMax(cells/row_stride, getRowChange, grid);
+        residuals[0] = residuals[1];
+        residual_iterations[0] = residual_iterations[1];
+        residuals[1] = residual;
+        residual_iterations[1] = iterations;
+        residual_count++;
+        residual_iteration = -1;
+    } else if (atomic_load(&residual_requested)) {
+        if (residual_grid == NULL) {
+            residual_grid = malloc(cells*sizeof(double));
+        }
+        memcpy(residual_grid, grid, cells*sizeof(double));
+        residual_iteration = iterations;
+        atomic_store(&residual_requested, 0);
+    }
+
+    if (atomic_load(&snapshot_requested)) {
+        memcpy(snapshot, grid, cells*sizeof(double));
+        snapshot_taken = 1;
+        atomic_store(&snapshot_requested, 0);
+        pthread_cond_broadcast(&job_changed);
+    }
+
+    pthread_mutex_unlock(&job_lock);
+}
+
+// Returns 1 once the job has been cancelled, which the backends check along
+// with convergence
+int isJobCancelled() {
+    return atomic_load(&job_cancelled);
+}
+
+// Fills in the progress of the job and asks for the residual to be measured
+// again, so that every poll refines the estimate the next poll gets
+void getJobProgress(JOB_PROGRESS* progress) {
+    pthread_mutex_lock(&job_lock);
+
+    progress->state = job_state;
+    progress->iterations = atomic_load(&job_iterations);
+    progress->elapsed = (getMonotonicNanoseconds() - job_start)*1e-9;
+    progress->residual = residual_count > 0 ? residuals[1] : -1;
+    progress->convergence_rate = -1;
+    progress->eta = -1;
+
+    // the residual shrinks by the convergence rate every iteration, so it
+    // falls below the precision after log(precision/residual)/log(rate) more
+    if (residual_count > 1 && residuals[0] > 0 && residual_iterations[1] > residual_iterations[0]) {
+        double rate = pow(residuals[1]/residuals[0], 1.0/(residual_iterations[1] - residual_iterations[0]));
+        progress->convergence_rate = rate;
+        if (residuals[1] <= decimal_value) {
+            progress->eta = 0;
+        } else if (rate < 1 && progress->iterations > 0) {
+            double iterations_left = log(decimal_value/residuals[1])/log(rate);
+            progress->eta = iterations_left*progress->elapsed/progress->iterations;
+        }
+    }
+
+    if (job_state == JOB_RUNNING && residual_iteration == -1) {
+        atomic_store(&residual_requested, 1);
+    }
+
+    pthread_mutex_unlock(&job_lock);
+}
+
+// Asks the job to stop at its next convergence check
+void cancelJob() {
+    atomic_store(&job_cancelled, 1);
+}
+
+// Returns a copy of the grid taken at the next iteration, without stopping the
+// worker threads, or of the final grid once the job has ended. The copy is
+// matrix_height rows of row_stride values, or matrix_size^3 values in 3
+// dimensions, and is the caller's to free. With the MPI backend the copy is of this rank's rows and halo rows
+double* takeSnapshot() {
+    double* copy = malloc(getGridCells()*sizeof(double));
+
+    pthread_mutex_lock(&job_lock);
+    if (job_state == JOB_RUNNING) {
+        snapshot = copy;
+        snapshot_taken = 0;
+        atomic_store(&snapshot_requested, 1);
+        while (!snapshot_taken && job_state == JOB_RUNNING) {
+            pthread_cond_wait(&job_changed, &job_lock);
+        }
+        atomic_store(&snapshot_requested, 0);
+    }
+    if (job_state != JOB_RUNNING && !snapshot_taken) {
+        memcpy(copy, getGrid(), getGridCells()*sizeof(double));
+    }
+    snapshot_taken = 0;
+    pthread_mutex_unlock(&job_lock);
+
+    return copy;
+}
+
+// Waits for the job to end, adds the time spent in the sequential and parallel
+// parts to the given totals and returns the number of iterations
+long long waitForJob(double* sequential_time_taken, double* parallel_time_taken) {
+    pthread_join(job_thread, NULL);
+    *sequential_time_taken += job_sequential_time_taken;
+    *parallel_time_taken += job_parallel_time_taken;
+    return atomic_load(&job_iterations);
+}
+
+// Waits for the job to end, printing its progress to stderr every interval
+// seconds if interval is positive, cancelling it once it has run for time_limit
+// seconds or is estimated to need longer, if time_limit is positive, and
+// writing a snapshot to checkpoint_file every checkpoint_interval seconds, if
+// checkpoint_interval is positive. With none of them the job is left alone, as
+// every poll makes it measure the residual
+void monitorJob(double interval, double time_limit, double checkpoint_interval, char* checkpoint_file) {
+    if (interval <= 0 && time_limit <= 0 && checkpoint_interval <= 0) {
+        return;
+    }
+
+    JOB_PROGRESS progress;
+    double poll_interval = 1;
+    if (interval > 0) {
+        poll_interval = interval;
+    }
+    if (checkpoint_interval > 0 && (interval <= 0 || checkpoint_interval < interval)) {
+        poll_interval = checkpoint_interval;
+    }
+    double last_checkpoint = 0;
+    int header_printed = 0;
+
+    pthread_mutex_lock(&job_lock);
+    while (job_state == JOB_RUNNING) {
+        struct timespec wake_time;
+        clock_gettime(CLOCK_REALTIME, &wake_time);
+        long long nanoseconds = wake_time.tv_nsec + (long long)(poll_interval*1e9);
+        wake_time.tv_sec += nanoseconds/1000000000;
+        wake_time.tv_nsec = nanoseconds%1000000000;
+        pthread_cond_timedwait(&job_changed, &job_lock, &wake_time);
+        if (job_state != JOB_RUNNING) {
+            break;
+        }
+        pthread_mutex_unlock(&job_lock);
+
+        getJobProgress(&progress);
+        if (interval > 0) {
+            if (!header_printed) {
+                fprintf(stderr, "elapsed, iterations, residual, convergence rate, eta\n");
+                header_printed = 1;
+            }
+            fprintf(stderr, "%f, %lld, %g, %f, %f\n", progress.elapsed, progress.iterations, progress.residual,
+                    progress.convergence_rate, progress.eta);
+        }
+        if (time_limit > 0 && (progress.elapsed >= time_limit ||
+                (progress.eta >= 0 && progress.elapsed + progress.eta > time_limit))) {
+            fprintf(stderr, "cancelled after %lld iterations, %f seconds, estimated %f seconds left\n",
+                    progress.iterations, progress.elapsed, progress.eta);
+            cancelJob();
+        }
+        if (checkpoint_interval > 0 && progress.elapsed - last_checkpoint >= checkpoint_interval) {
+            double* checkpoint = takeSnapshot();
+            if (writeGrid(checkpoint_file, checkpoint)) {
+                fprintf(stderr, "could not write checkpoint '%s'\n", checkpoint_file);
+            }
+            free(checkpoint);
+            last_checkpoint = progress.elapsed;
+        }
+
+        pthread_mutex_lock(&job_lock);
+    }
+    pthread_mutex_unlock(&job_lock);
+}
@@ -0,0 +1,343 @@
+/**
+* Distributed memory backend
+* Oliver Redeyoff
+*
+* With -x mpi the interior rows of the matrix are split between the MPI ranks
+* as evenly as possible and each rank only holds its own rows plus a halo row
+* above and below them, which are the last and first rows of its neighbours.
+* Within a rank the rows are split into blocks for the worker threads as usual,
+* and the rank's main thread plays the part the main thread has in the barrier
+* backend, with communication added to it:
+*
+* 1 - after the update step the main thread posts non-blocking sends of the
+*     rank's first and last rows to its neighbours, and receives into the halo
+*     rows, then releases the worker threads at barrier 2
+*
+* 2 - the worker threads relax the rows of their block which don't need the
+*     halo rows, while the main thread waits for the exchange to finish and then
+*     flags the halo rows as ready. The worker threads then relax their rows
+*     next to the halo rows, if they have any, and wait at barrier 1
+*
+* 3 - the main thread combines its rank's value_change_flag with the other
+*     ranks' in an allreduce, so that every rank stops at the same iteration
+*
+* The halo rows are never read while they are being received, and the rows
+* being sent are only changed by the update step, which comes after the
+* exchange has finished, so no copies are needed. The rank's matrix starts from
+* the same values as the full matrix would, so the result is the same as with
+* the other backends.
+*
+* MPI is only used when built with make mpi, which defines RELAXATION_MPI.
+* Without it, -x mpi is rejected and the program runs as a single rank.
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "relaxation_technique.h"
+
+int rank = 0;
+int rank_count = 1;
+
+// global index of the first of this rank's rows
+int first_row = 1;
+
+#ifdef RELAXATION_MPI
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <mpi.h>
+
+extern pthread_barrier_t barrier_1;
+extern pthread_barrier_t barrier_2;
+
+// relaxation step of the problem, which processDistributedBlock() runs on the
+// rows of a block in two parts
+static void (*process_rows)(BLOCK* block);
+
+// set by the main thread once the halo rows have been received
+static atomic_int halos_ready;
+
+static MPI_Request halo_requests[4];
+static int halo_request_count;
+
+// Initialises MPI, which the solve job's thread calls into while the main
+// thread waits for it, and returns 0, or returns 1 if MPI can't be used
+int startDistribution(int* argc, char*** argv) {
+    int provided;
+    MPI_Init_thread(argc, argv, MPI_THREAD_SERIALIZED, &provided);
+    if (provided < MPI_THREAD_SERIALIZED) {
+        printf("The MPI library does not support calls from a thread other than the main one\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &rank_count);
+    return 0;
+}
+
+// Shuts MPI down
+void endDistribution() {
+    MPI_Finalize();
+}
+
+// Gives the global index of the first row of the given rank and the number of
+// rows it holds, the first ranks taking one more row than the others when the
+// rows can't be split evenly
+static void getRankRows(int of_rank, int* rank_first_row, int* rank_rows) {
+    int interior_rows = matrix_height - 2;
+    int equal_rows = interior_rows/rank_count;
+    int extra_rows = interior_rows%rank_count;
+
+    *rank_first_row = 1 + equal_rows*of_rank + (of_rank < extra_rows ? of_rank : extra_rows);
+    *rank_rows = equal_rows + (of_rank < extra_rows ? 1 : 0);
+}
+
+// Makes matrix hold this rank's rows and the halo rows around them, taken from
+// the input file if there is one, and sets owned_rows and first_row to match.
+// Returns 0, or 1 if there are more ranks than rows or the file can't be read
+int setUpDistributedMatrix(char* input_file) {
+    if (rank_count > matrix_height-2) {
+        printf("There are more ranks than rows to share between them\n");
+        return 1;
+    }
+    getRankRows(rank, &first_row, &owned_rows);
+
+    double* values = makeGrid(owned_rows+2);
+
+    if (input_file != NULL) {
+        double* full_matrix = loadGrid(input_file);
+        if (full_matrix == NULL) {
+            return 1;
+        }
+        memcpy(values, &full_matrix[(first_row-1)*row_stride], (owned_rows+2)*row_stride*sizeof(double));
+        free(full_matrix);
+    } else {
+        for (int i=0 ; i<owned_rows+2 ; i++) {
+            int row = first_row - 1 + i;
+            for (int j=0 ; j<matrix_width ; j++) {
+                if (row==0 || j==0 || row==matrix_height-1 || j==matrix_width-1) {
+                    values[i*row_stride + j] = getEdgeValue(row, j);
+                } else {
+                    values[i*row_stride + j] = 0.0;
+                }
+            }
+        }
+    }
+
+    matrix = values;
+    return 0;
+}
+
+// Returns the part of a full matrix sized grid, such as the Poisson source,
+// which lines up with this rank's matrix
+double* getRankGrid(double* grid) {
+    return grid != NULL ? &grid[(first_row-1)*row_stride] : NULL;
+}
+
+// Posts the exchange of this rank's first and last rows with its neighbours'
+// halo rows, which leaves out the padding at the end of each row
+static void startHaloExchange() {
+    halo_request_count = 0;
+    if (rank > 0) {
+        MPI_Irecv(&matrix[0], matrix_width, MPI_DOUBLE, rank-1, 0, MPI_COMM_WORLD, &halo_requests[halo_request_count++]);
+        MPI_Isend(&matrix[row_stride], matrix_width, MPI_DOUBLE, rank-1, 0, MPI_COMM_WORLD, &halo_requests[halo_request_count++]);
+    }
+    if (rank < rank_count-1) {
+        MPI_Irecv(&matrix[(owned_rows+1)*row_stride], matrix_width, MPI_DOUBLE, rank+1, 0, MPI_COMM_WORLD,
+                &halo_requests[halo_request_count++]);
+        MPI_Isend(&matrix[owned_rows*row_stride], matrix_width, MPI_DOUBLE, rank+1, 0, MPI_COMM_WORLD,
+                &halo_requests[halo_request_count++]);
+    }
+}
+
+// Waits for the halo exchange to finish and flags the halo rows as ready
+static void finishHaloExchange() {
+    MPI_Waitall(halo_request_count, halo_requests, MPI_STATUSES_IGNORE);
+    atomic_store_explicit(&halos_ready, 1, memory_order_release);
+}
+
+// Relaxes rows start_row to end_row of the given block
+static void processRows(BLOCK* block, int start_row, int end_row) {
+    if (start_row > end_row) {
+        return;
+    }
+
+    BLOCK rows = *block;
+    rows.start_row = start_row;
+    rows.end_row = end_row;
+    rows.new_values = &block->new_values[(start_row-block->start_row)*row_stride];
+    process_rows(&rows);
+}
+
+// Relaxes the rows of the given block which don't need the halo rows while they
+// are exchanged, then the rest once they have arrived
+static void processDistributedBlock(BLOCK* block) {
+    // blocks left without rows when there are more threads than rows
+    if (block->start_row > block->end_row) {
+        return;
+    }
+
+    int start_row = block->start_row > 2 ? block->start_row : 2;
+    int end_row = block->end_row < owned_rows-1 ? block->end_row : owned_rows-1;
+    processRows(block, start_row, end_row);
+
+    while (!atomic_load_explicit(&halos_ready, memory_order_acquire)) {
+        sched_yield();
+    }
+
+    if (block->start_row == 1) {
+        processRows(block, 1, 1);
+    }
+    if (block->end_row == owned_rows && owned_rows > 1) {
+        processRows(block, owned_rows, owned_rows);
+    }
+}
+
+// Runs the MPI backend, adding the time spent in each part to the given totals,
+// with the halo exchange counted in the parallel part it overlaps and the
+// allreduce in the sequential part, and returns the number of iterations
+long long solveDistributed(double* sequential_time_taken, double* parallel_time_taken) {
+    struct timespec parallel_start, parallel_end;
+    struct timespec sequential_start, sequential_end;
+    long long iterations = 0;
+
+    process_rows = process_block;
+    process_block = processDistributedBlock;
+    atomic_init(&halos_ready, 0);
+
+    pthread_barrier_init(&barrier_1, NULL, thread_count+1);
+    pthread_barrier_init(&barrier_2, NULL, thread_count+1);
+
+    startHaloExchange();
+    solve_finished = 0;
+    startPoolPhase(runBlockWorker);
+
+    while (1) {
+
+        // finish the exchange while the worker threads relax the rows which
+        // don't need it, then wait for them at barrier 1
+        clock_gettime(CLOCK_MONOTONIC, &parallel_start);
+        PHASE_TIME(wait_start);
+        finishHaloExchange();
+        pthread_barrier_wait(&barrier_1);
+        PHASE_TIME(wait_end);
+        clock_gettime(CLOCK_MONOTONIC, &parallel_end);
+        *parallel_time_taken += getTimeTaken(parallel_start, parallel_end);
+        TRACE_PHASE(0, TRACE_BARRIER_WAIT, wait_start, wait_end);
+
+        // every rank goes on while any rank has a changed value and none has
+        // been cancelled
+        clock_gettime(CLOCK_MONOTONIC, &sequential_start);
+        atomic_store_explicit(&halos_ready, 0, memory_order_relaxed);
+        int local_state[2] = {value_change_flag, isJobCancelled()};
+        int global_state[2];
+        MPI_Allreduce(local_state, global_state, 2, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+        if (global_state[0] == 0 || global_state[1]) {
+            applyFinalSweep();
+            break;
+        } else {
+            value_change_flag = 0;
+        }
+        PHASE_TIME(check_end);
+        TRACE_PHASE(0, TRACE_CONVERGENCE_CHECK, wait_end, check_end);
+
+        update_values();
+        iterations++;
+        serviceJob(iterations);
+        startHaloExchange();
+        PHASE_TIME(update_end);
+        TRACE_PHASE(0, TRACE_UPDATE, check_end, update_end);
+
+        // wait to synchronise with worker threads at barrier 2
+        clock_gettime(CLOCK_MONOTONIC, &sequential_end);
+        pthread_barrier_wait(&barrier_2);
+        PHASE_TIME(release_end);
+        *sequential_time_taken += getTimeTaken(sequential_start, sequential_end);
+        INSTRUMENT_ADD(thread_count, compute_nanoseconds, (long long)(getTimeTaken(sequential_start, sequential_end)*1e9));
+        TRACE_PHASE(0, TRACE_BARRIER_WAIT, update_end, release_end);
+
+    }
+
+    // release the worker threads from barrier 2 to end
+    solve_finished = 1;
+    pthread_barrier_wait(&barrier_2);
+    finishPoolPhase();
+    pthread_barrier_destroy(&barrier_1);
+    pthread_barrier_destroy(&barrier_2);
+    process_block = process_rows;
+
+    return iterations;
+}
+
+// Gathers every rank's rows into a full matrix on rank 0, which replaces its
+// own rows in matrix so that the result can be written out. The rows are sent
+// as a datatype of a whole row, so that the counts stay within an int however
+// many values the matrix holds. Returns 0 on success and 1 on every rank if
+// rank 0 can't allocate the full matrix
+int gatherMatrix() {
+    int counts[rank_count];
+    int displacements[rank_count];
+
+    // the first and last ranks also hold the top and bottom edge rows
+    for (int i=0 ; i<rank_count ; i++) {
+        int rank_first_row, rank_rows;
+        getRankRows(i, &rank_first_row, &rank_rows);
+        int start = i == 0 ? 0 : rank_first_row;
+        int end = i == rank_count-1 ? matrix_height : rank_first_row + rank_rows;
+        counts[i] = end - start;
+        displacements[i] = start;
+    }
+
+    double* full_matrix = rank == 0 ? makeGrid(matrix_height) : NULL;
+    int failed = rank == 0 && full_matrix == NULL;
+    MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (failed) {
+        return 1;
+    }
+
+    MPI_Datatype row_type;
+    MPI_Type_contiguous(row_stride, MPI_DOUBLE, &row_type);
+    MPI_Type_commit(&row_type);
+    double* rows = rank == 0 ? matrix : &matrix[row_stride];
+    MPI_Gatherv(rows, counts[rank], row_type, full_matrix, counts, displacements, row_type, 0, MPI_COMM_WORLD);
+    MPI_Type_free(&row_type);
+
+    if (rank == 0) {
+        free(matrix);
+        matrix = full_matrix;
+    }
+    return 0;
+}
+
+#else
+
+int startDistribution(int* argc, char*** argv) {
+    printf("This build has no MPI support, build it with make mpi\n");
+    return 1;
+}
+
+void endDistribution() {
+}
+
+int setUpDistributedMatrix(char* input_file) {
+    return 1;
+}
+
+double* getRankGrid(double* grid) {
+    return grid;
+}
+
+long long solveDistributed(double* sequential_time_taken, double* parallel_time_taken) {
+    return 0;
+}
+
+int gatherMatrix() {
+    return 1;
+}
+
+#endif
@@ -0,0 +1,180 @@
+/**
+* Nested iteration
+* Oliver Redeyoff
+*
+* Starting the fine grid from a zero interior means most of its sweeps only
+* carry the boundary values inwards, which a coarser grid does in far fewer
+* sweeps of far fewer cells. With -M levels, the problem is first solved on a
+* grid with half as many intervals across and down for every level, from the coarsest
+* up, each level starting from its coarser neighbour's solution interpolated
+* bilinearly onto it, and the fine grid then starts from the finest of them.
+*
+* Every level runs the same Jacobi relaxation, on the selected backend, to the
+* same precision as the fine grid. The coarse levels always use the plain
+* kernels, in place relaxation and acceleration only being used on the fine
+* grid, whose solve and output are otherwise unchanged. The timing line counts
+* every level's time, while the roofline and hardware counters only describe
+* the fine grid's solve, as their sweeps and cells are the fine grid's.
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "relaxation_technique.h"
+
+// smallest grid a level may have, which still has interior cells to relax
+#define NESTED_MIN_SIZE 5
+// most levels halving an int size can give before reaching the smallest grid
+#define NESTED_MAX_LEVELS 31
+
+// solution of the finest coarse level, which the fine grid is interpolated from
+static double* coarse_matrix;
+static int coarse_width;
+static int coarse_height;
+static int coarse_stride;
+
+// Returns 1 if argument is a plain number rather than the name of a file, which
+// only fits a grid of one size
+static int isConstantArgument(char* argument) {
+    char* end;
+    strtod(argument, &end);
+    return end != argument && *end == '\0';
+}
+
+// Fills the interior of values, a grid laid out as the current matrix is, by
+// bilinear interpolation of the coarse solution, both grids covering the same
+// rectangle
+static void interpolate(double* values) {
+    double scale_x = (double)(coarse_width-1)/(matrix_width-1);
+    double scale_y = (double)(coarse_height-1)/(matrix_height-1);
+
+    for (int i=1 ; i<matrix_height-1 ; i++) {
+        double y = i*scale_y;
+        int coarse_i = (int)y < coarse_height-1 ? (int)y : coarse_height-2;
+        double fraction_i = y - coarse_i;
+        double* upper = &coarse_matrix[coarse_i*coarse_stride];
+        double* lower = upper + coarse_stride;
+
+        for (int j=1 ; j<matrix_width-1 ; j++) {
+            double x = j*scale_x;
+            int coarse_j = (int)x < coarse_width-1 ? (int)x : coarse_width-2;
+            double fraction_j = x - coarse_j;
+
+            double top = upper[coarse_j] + fraction_j*(upper[coarse_j+1] - upper[coarse_j]);
+            double bottom = lower[coarse_j] + fraction_j*(lower[coarse_j+1] - lower[coarse_j]);
+            values[i*row_stride + j] = top + fraction_i*(bottom - top);
+        }
+    }
+}
+
+// Solves the problem on levels coarser grids than the fine one, each starting
+// from the interpolated solution of the one before, adding the time spent to the
+// given totals and printing each level's sweeps to stderr. Returns 0, or 1 if a
+// level can't be set up
+int solveCoarseLevels(int levels, int stencil, char* source_argument, char* coefficient_argument,
+        double* sequential_time_taken, double* parallel_time_taken) {
+    int fine_width = matrix_width;
+    int fine_height = matrix_height;
+    int fine_stride = row_stride;
+    int fine_in_place = in_place;
+    int poisson = source_argument != NULL || coefficient_argument != NULL;
+
+    if ((source_argument != NULL && !isConstantArgument(source_argument)) ||
+            (coefficient_argument != NULL && !isConstantArgument(coefficient_argument))) {
+        printf("Nested iteration only supports constant sources and coefficients\n");
+        return 1;
+    }
+
+    // halve the intervals per level, stopping once either side would be
+    // smaller than the smallest useful grid
+    int widths[NESTED_MAX_LEVELS];
+    int heights[NESTED_MAX_LEVELS];
+    int level_count = 0;
+    int width = fine_width;
+    int height = fine_height;
+    while (level_count < levels && level_count < NESTED_MAX_LEVELS && (width-1)/2 + 1 >= NESTED_MIN_SIZE && (height-1)/2 + 1 >= NESTED_MIN_SIZE) {
+        width = (width-1)/2 + 1;
+        height = (height-1)/2 + 1;
+        widths[level_count] = width;
+        heights[level_count++] = height;
+    }
+
+    // the coarse levels pick their own row stride, as -L only sets the fine one
+    in_place = 0;
+    for (int level=level_count-1 ; level>=0 ; level--) {
+        matrix_width = widths[level];
+        matrix_height = heights[level];
+        matrix_size = matrix_width;
+        row_stride = chooseRowStride(matrix_width);
+        owned_rows = matrix_height - 2;
+        row_kernel = selectRowKernel(stencil, matrix_width);
+
+        matrix = makeMatrix();
+        if (matrix == NULL) {
+            return 1;
+        }
+        if (coarse_matrix != NULL) {
+            interpolate(matrix);
+            free(coarse_matrix);
+        }
+        if (hasNeumannBoundaries()) {
+            applyNeumannBoundaries();
+        }
+        blocks = makeBlocks();
+
+        process_block = processBlock;
+        update_values = hasNeumannBoundaries() ? updatePoissonMatrix : updateMatrix;
+        update_block = NULL;
+        if (poisson) {
+            if (setUpPoisson(source_argument, coefficient_argument, stencil)) {
+                return 1;
+            }
+            process_block = processPoissonBlock;
+        }
+
+        double level_sequential_time = 0;
+        double level_parallel_time = 0;
+        value_change_flag = 0;
+        long long iterations = solveWithBackend(&level_sequential_time, &level_parallel_time);
+        fprintf(stderr, "level %d, size %dx%d, sweeps %lld, time %f\n", level_count - level, matrix_width,
+                matrix_height, iterations, level_sequential_time + level_parallel_time);
+        *sequential_time_taken += level_sequential_time;
+        *parallel_time_taken += level_parallel_time;
+
+        // keep the solution for the next level
+        coarse_matrix = matrix;
+        coarse_width = matrix_width;
+        coarse_height = matrix_height;
+        coarse_stride = row_stride;
+        for (int i=0 ; i<thread_count ; i++) {
+            free(blocks[i].new_values);
+        }
+        free(blocks);
+        if (poisson) {
+            free(source);
+            free(coefficients);
+            source = NULL;
+            coefficients = NULL;
+        }
+    }
+
+    matrix_width = fine_width;
+    matrix_height = fine_height;
+    matrix_size = fine_width;
+    row_stride = fine_stride;
+    owned_rows = matrix_height - 2;
+    row_kernel = selectRowKernel(stencil, matrix_width);
+    in_place = fine_in_place;
+    return 0;
+}
+
+// Fills the interior of matrix with the solution of the finest coarse level, if
+// solveCoarseLevels() solved any
+void interpolateCoarseSolution() {
+    if (coarse_matrix != NULL) {
+        interpolate(matrix);
+        free(coarse_matrix);
+        coarse_matrix = NULL;
+    }
+}
@@ -0,0 +1,263 @@
+/**
+* Hardware performance counters
+* Oliver Redeyoff
+*
+* When asked for, every worker thread and the main thread open a group of
+* hardware counters for themselves with perf_event_open (cycles, instructions
+* and last level cache misses) and read them at the start and end of every
+* phase in which they relax or update values, so that time spent waiting at
+* barriers is left out. Once the solve ends the counts are added up and
+* reported next to the timing line together with the memory bandwidth and
+* flop rate they imply, both from the counters (a last level cache miss moves
+* one cache line from memory) and from a model of the bytes and flops each cell
+* update needs, which shows how close each kernel gets to the hardware's limits.
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "relaxation_technique.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// bytes moved between memory and the last level cache by each miss
+#define CACHE_LINE_BYTES 64
+
+#define HARDWARE_CYCLES 0
+#define HARDWARE_INSTRUCTIONS 1
+#define HARDWARE_CACHE_MISSES 2
+#define HARDWARE_COUNTER_COUNT 3
+
+// the group's leader is its cycles counter, whose file descriptor reads the
+// group, and members holds the others' so that they can be closed
+typedef struct hardware_counters {
+    int group;
+    int phase_depth;
+    long long phase_start[HARDWARE_COUNTER_COUNT];
+    long long totals[HARDWARE_COUNTER_COUNT];
+    int members[HARDWARE_COUNTER_COUNT-1];
+} HARDWARE_COUNTERS;
+
+int perf_enabled;
+
+// counters of the main thread, at index 0, and each worker thread after it
+static HARDWARE_COUNTERS* hardware_counters;
+static int hardware_unavailable;
+
+// Allocates the counters of the main thread and every worker thread, which each
+// open their own with startHardwareCounters
+void makeHardwareCounters() {
+    hardware_counters = makeCacheAligned(thread_count+1, sizeof(HARDWARE_COUNTERS));
+    for (int i=0 ; i<=thread_count ; i++) {
+        hardware_counters[i].group = -1;
+    }
+    perf_enabled = 1;
+}
+
+#ifdef __linux__
+// Opens a counter of the calling thread in the given group, or as the leader of
+// a new group when group is -1, and returns its file descriptor or -1
+static int openCounter(unsigned long long config, int group) {
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.config = config;
+    attributes.disabled = group == -1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.read_format = PERF_FORMAT_GROUP;
+
+    return syscall(SYS_perf_event_open, &attributes, 0, -1, group, 0);
+}
+#endif
+
+// Opens the counters of the calling thread, 0 being the main thread and the
+// worker thread relaxing blocks[i] being i+1. Counting stays off for every
+// thread if the counters can't be opened, and later calls don't try again, as
+// the pool's tasks call this for every task their thread runs until it counts
+void startHardwareCounters(int thread) {
+    if (hardware_unavailable) {
+        return;
+    }
+#ifdef __linux__
+    int group = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+    int instructions = group != -1 ? openCounter(PERF_COUNT_HW_INSTRUCTIONS, group) : -1;
+    int cache_misses = instructions != -1 ? openCounter(PERF_COUNT_HW_CACHE_MISSES, group) : -1;
+    if (cache_misses != -1) {
+        hardware_counters[thread].group = group;
+        hardware_counters[thread].members[0] = instructions;
+        hardware_counters[thread].members[1] = cache_misses;
+        ioctl(group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return;
+    }
+
+    if (instructions != -1) {
+        close(instructions);
+    }
+    if (group != -1) {
+        close(group);
+    }
+#endif
+    hardware_unavailable = 1;
+}
+
+// Closes the counters of every thread once counting has ended, after which
+// their totals can still be printed
+void stopHardwareCounters() {
+    for (int i=0 ; i<=thread_count ; i++) {
+        if (hardware_counters[i].group == -1) {
+            continue;
+        }
+        for (int m=0 ; m<HARDWARE_COUNTER_COUNT-1 ; m++) {
+            close(hardware_counters[i].members[m]);
+        }
+        close(hardware_counters[i].group);
+        hardware_counters[i].group = -1;
+    }
+}
+
+// Returns 1 if the given thread's counters are open
+int isCountingHardware(int thread) {
+    return hardware_counters[thread].group != -1;
+}
+
+// Reads the current counts of the given thread's counters into values
+static int readCounters(int thread, long long* values) {
+    struct {
+        long long count;
+        long long values[HARDWARE_COUNTER_COUNT];
+    } group_values;
+
+    int group = hardware_counters[thread].group;
+    if (group == -1 || read(group, &group_values, sizeof(group_values)) != sizeof(group_values)) {
+        return 1;
+    }
+    memcpy(values, group_values.values, sizeof(group_values.values));
+    return 0;
+}
+
+// Marks the start of a phase of the given thread which should be counted. A
+// phase may start within another, such as a parallel loop's task run inline by
+// the thread counting the step it is part of, and is then counted by it
+void beginHardwarePhase(int thread) {
+    if (hardware_counters[thread].phase_depth++ == 0) {
+        readCounters(thread, hardware_counters[thread].phase_start);
+    }
+}
+
+// Marks the end of a phase of the given thread, adding what it counted to the
+// thread's totals
+void endHardwarePhase(int thread) {
+    long long values[HARDWARE_COUNTER_COUNT];
+    if (--hardware_counters[thread].phase_depth > 0 || readCounters(thread, values)) {
+        return;
+    }
+    for (int i=0 ; i<HARDWARE_COUNTER_COUNT ; i++) {
+        hardware_counters[thread].totals[i] += values[i] - hardware_counters[thread].phase_start[i];
+    }
+}
+
+// Returns the number of cells updated by each sweep
+long long getSweepCells() {
+    if (dimensions == 3) {
+        long long interior = matrix_size - 2;
+        return interior*interior*interior;
+    }
+    return (long long)(matrix_width-2)*(matrix_height-2);
+}
+
+// Returns the number of bytes each cell update moves to and from memory, when
+// the matrix is too large to stay in cache, counting the write allocate of every
+// cache line written without being read first. Neighbouring rows are assumed
+// to be reused from cache, so each grid the update touches costs its reads and
+// writes once
+int getBytesPerCell() {
+    int bytes;
+    if (dimensions == 3) {
+        // read volume, write and allocate next_volume
+        bytes = 3*8;
+    } else if (in_place) {
+        // read matrix and write it back, the rolling row buffers stay in cache
+        bytes = 2*8;
+    } else {
+        // read matrix, write and allocate new_values, then read new_values and
+        // write matrix in the update step
+        bytes = 5*8;
+    }
+
+    if (source != NULL) {
+        bytes += 8;
+    }
+    if (coefficients != NULL) {
+        bytes += 8;
+    }
+    if (acceleration == ACCELERATION_CHEBYSHEV) {
+        // read and write previous_values, and read and write new_values again
+        bytes += 4*8;
+    } else if (acceleration == ACCELERATION_ANDERSON) {
+        // write both newest differences, read every difference twice and the
+        // previous residual and update, and read new_values again
+        bytes += (2 + 4*anderson_depth + 4 + 1)*8;
+    }
+
+    return bytes;
+}
+
+// Returns the number of floating point operations each cell update takes,
+// counting the change test as one
+int getFlopsPerCell() {
+    int flops;
+    if (dimensions == 3) {
+        flops = 5 + 1 + 1;
+    } else if (coefficients != NULL) {
+        flops = 8 + 7 + 2 + 3 + 1 + 1;
+    } else if (stencil == STENCIL_9_POINT) {
+        flops = 6 + 2 + 1 + 1 + (source != NULL ? 3 : 0);
+    } else {
+        flops = 3 + 1 + 1 + (source != NULL ? 2 : 0);
+    }
+
+    if (acceleration == ACCELERATION_CHEBYSHEV) {
+        flops += 3;
+    } else if (acceleration == ACCELERATION_ANDERSON) {
+        flops += 3 + 4*anderson_depth;
+    }
+
+    return flops;
+}
+
+// Prints the counts of every thread added up, with the bandwidth and flop rate
+// they imply over the given time spent in the solve, to stderr
+void printHardwareCounters(double time_taken, long long iterations) {
+    if (hardware_unavailable) {
+        fprintf(stderr, "hardware counters unavailable, check perf_event_paranoid\n");
+    }
+
+    long long totals[HARDWARE_COUNTER_COUNT] = {0, 0, 0};
+    for (int i=0 ; i<=thread_count ; i++) {
+        for (int c=0 ; c<HARDWARE_COUNTER_COUNT ; c++) {
+            totals[c] += hardware_counters[i].totals[c];
+        }
+    }
+
+    double cells = (double)getSweepCells()*iterations;
+    double measured_bandwidth = totals[HARDWARE_CACHE_MISSES]*(double)CACHE_LINE_BYTES/time_taken*1e-9;
+    double model_bandwidth = cells*getBytesPerCell()/time_taken*1e-9;
+    double flop_rate = cells*getFlopsPerCell()/time_taken*1e-9;
+
+    fprintf(stderr, "cycles, instructions, llc misses, instructions per cycle, instructions per cell, "
+            "measured GB/s, model bytes per cell, model GB/s, flops per cell, GFLOP/s\n");
+    fprintf(stderr, "%lld, %lld, %lld, %f, %f, %f, %d, %f, %d, %f\n",
+            totals[HARDWARE_CYCLES], totals[HARDWARE_INSTRUCTIONS], totals[HARDWARE_CACHE_MISSES],
+            totals[HARDWARE_CYCLES] > 0 ? (double)totals[HARDWARE_INSTRUCTIONS]/totals[HARDWARE_CYCLES] : 0.0,
+            cells > 0 ? totals[HARDWARE_INSTRUCTIONS]/cells : 0.0,
+            measured_bandwidth, getBytesPerCell(), model_bandwidth, getFlopsPerCell(), flop_rate);
+}
@@ -0,0 +1,264 @@
+/**
+* Poisson problems
+* Oliver Redeyoff
+*
+* Generalises the Laplace problem to -div(a grad u) = f on a rectangle one unit
+* wide, with the same spacing between cells across and down, with an optional
+* source term f, optional variable diffusion coefficients a and a Dirichlet
+* (fixed value) or Neumann (fixed outward derivative) condition on each side.
+* Both f and a are given per cell, either as a single constant or as a file of
+* matrix_height rows of matrix_width space separated values.
+*
+* Only the parts of the problem which are actually used cost anything: the
+* Poisson kernels are only selected when there is a source term or variable
+* coefficients, and Neumann sides are only updated when there are some, so the
+* plain Laplace problem still runs through processBlock() and updateMatrix().
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "relaxation_technique.h"
+
+// the condition on each side of the matrix, top and left held at 1.0 by default
+BOUNDARY boundaries[4] = {
+    {BOUNDARY_DIRICHLET, 1.0},
+    {BOUNDARY_DIRICHLET, 1.0},
+    {BOUNDARY_DIRICHLET, 0.0},
+    {BOUNDARY_DIRICHLET, 0.0},
+};
+
+// per cell source term and diffusion coefficients, NULL when not used
+double* source;
+double* coefficients;
+POISSON_ROW_KERNEL poisson_row_kernel;
+double spacing_squared;
+
+// Returns the value an edge cell starts with, taken from the first Dirichlet side
+// it lies on in the order top, left, bottom, right, so that corners shared by two
+// sides take the value of the side that comes first
+double getEdgeValue(int i, int j) {
+    int on_side[4] = {i == 0, j == 0, i == matrix_height-1, j == matrix_width-1};
+
+    for (int side=0 ; side<4 ; side++) {
+        if (on_side[side] && boundaries[side].type == BOUNDARY_DIRICHLET) {
+            return boundaries[side].value;
+        }
+    }
+
+    return 0.0;
+}
+
+// Reads one side's condition from a spec of the form side:type:value, where side
+// is top, left, bottom or right and type is dirichlet or neumann (or d or n).
+// Returns 0 on success and 1 if the spec could not be understood
+static int parseBoundary(char* spec) {
+    char side_name[16], type_name[16];
+    double value;
+
+    if (sscanf(spec, "%15[^:]:%15[^:]:%lf", side_name, type_name, &value) != 3) {
+        return 1;
+    }
+
+    char side_names[4][8] = {"top", "left", "bottom", "right"};
+    int side = -1;
+    for (int i=0 ; i<4 ; i++) {
+        if (strcmp(side_name, side_names[i]) == 0) {
+            side = i;
+        }
+    }
+
+    int type;
+    if (strcmp(type_name, "dirichlet") == 0 || strcmp(type_name, "d") == 0) {
+        type = BOUNDARY_DIRICHLET;
+    } else if (strcmp(type_name, "neumann") == 0 || strcmp(type_name, "n") == 0) {
+        type = BOUNDARY_NEUMANN;
+    } else {
+        return 1;
+    }
+
+    if (side == -1) {
+        return 1;
+    }
+    boundaries[side].type = type;
+    boundaries[side].value = value;
+
+    return 0;
+}
+
+// Reads a comma separated list of side conditions into boundaries. Returns 0 on
+// success and 1 if any of them could not be understood
+int parseBoundaries(char* specs) {
+    char* copy = strdup(specs);
+    int error = 0;
+
+    for (char* spec=strtok(copy, ",") ; spec!=NULL ; spec=strtok(NULL, ",")) {
+        if (parseBoundary(spec)) {
+            printf("Unsupported boundary '%s', use side:type:value\n", spec);
+            error = 1;
+        }
+    }
+
+    free(copy);
+    return error;
+}
+
+// Returns 1 if any side has a Neumann condition
+int hasNeumannBoundaries() {
+    for (int side=0 ; side<4 ; side++) {
+        if (boundaries[side].type == BOUNDARY_NEUMANN) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns a grid of matrix_height rows of matrix_width doubles, laid out as the
+// matrix is, filled either with the number argument is, or with the values read
+// from the file it names, which is either text or a compressed grid file.
+// Returns NULL and prints why if the file can't be read
+double* loadGrid(char* argument) {
+    double* values = makeGrid(matrix_height);
+
+    // a plain number fills every cell
+    char* end;
+    double constant = strtod(argument, &end);
+    if (end != argument && *end == '\0') {
+        for (int i=0 ; i<matrix_height ; i++) {
+            for (int j=0 ; j<matrix_width ; j++) {
+                values[i*row_stride + j] = constant;
+            }
+        }
+        return values;
+    }
+
+    if (isCompressedGrid(argument)) {
+        free(values);
+        return loadCompressedGrid(argument, matrix_height);
+    }
+
+    FILE* file = fopen(argument, "r");
+    if (file == NULL) {
+        printf("Could not open '%s'\n", argument);
+        free(values);
+        return NULL;
+    }
+
+    for (int i=0 ; i<matrix_height ; i++) {
+        for (int j=0 ; j<matrix_width ; j++) {
+            if (fscanf(file, "%lf", &values[i*row_stride + j]) != 1) {
+                printf("'%s' holds fewer than %d values\n", argument, matrix_width*matrix_height);
+                fclose(file);
+                free(values);
+                return NULL;
+            }
+        }
+    }
+
+    fclose(file);
+    return values;
+}
+
+// Loads the source term and coefficients and picks the kernel for them. Either
+// argument may be NULL, in which case there is no source term or the coefficients
+// are all 1. Returns 0 on success and 1 if the problem can't be set up
+int setUpPoisson(char* source_argument, char* coefficient_argument, int stencil) {
+    spacing_squared = 1.0/((double)(matrix_width-1)*(matrix_width-1));
+
+    source = loadGrid(source_argument != NULL ? source_argument : "0");
+    if (source == NULL) {
+        return 1;
+    }
+
+    if (coefficient_argument != NULL) {
+        coefficients = loadGrid(coefficient_argument);
+        if (coefficients == NULL) {
+            return 1;
+        }
+    }
+
+    poisson_row_kernel = selectPoissonRowKernel(stencil, coefficients != NULL);
+    if (poisson_row_kernel == NULL) {
+        printf("Variable coefficients are only supported with the 5 point stencil\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+// Performs relaxation of the Poisson problem for the rows of matrix defined in
+// the given block, storing the results in the block's new_values
+void processPoissonBlock(BLOCK* block) {
+    int changed = 0;
+
+    for(int row=block->start_row ; row<=block->end_row ; row++) {
+        double* current_row = &matrix[row*row_stride];
+        double* new_row = &block->new_values[(row-block->start_row)*row_stride];
+        double* coefficient_row = coefficients != NULL ? &coefficients[row*row_stride] : NULL;
+
+        changed |= poisson_row_kernel(current_row - row_stride, current_row, current_row + row_stride,
+                &source[row*row_stride],
+                coefficient_row != NULL ? coefficient_row - row_stride : NULL,
+                coefficient_row,
+                coefficient_row != NULL ? coefficient_row + row_stride : NULL,
+                new_row, matrix_width, spacing_squared, decimal_value);
+    }
+
+    if (changed) {
+        value_change_flag = 1;
+    }
+}
+
+// Sets a corner between two Neumann sides, which no Dirichlet side gives a
+// value, to the mean of what each side's condition gives it from the edge cell
+// next to it on the other side
+static void applyNeumannCorner(int row, int column, int row_side, int column_side, double spacing) {
+    if (boundaries[row_side].type != BOUNDARY_NEUMANN || boundaries[column_side].type != BOUNDARY_NEUMANN) {
+        return;
+    }
+    int inner_row = row == 0 ? 1 : row-1;
+    int inner_column = column == 0 ? 1 : column-1;
+
+    matrix[row*row_stride + column] = 0.5*(
+            matrix[inner_row*row_stride + column] + spacing*boundaries[row_side].value +
+            matrix[row*row_stride + inner_column] + spacing*boundaries[column_side].value);
+}
+
+// Sets the cells of every Neumann side so that the outward derivative across
+// the side matches the side's value, then the corners between two of them
+void applyNeumannBoundaries() {
+    double spacing = 1.0/(matrix_width-1);
+    int last_row = matrix_height-1;
+    int last_column = matrix_width-1;
+
+    for (int k=1 ; k<last_column ; k++) {
+        if (boundaries[BOUNDARY_TOP].type == BOUNDARY_NEUMANN) {
+            matrix[k] = matrix[row_stride + k] + spacing*boundaries[BOUNDARY_TOP].value;
+        }
+        if (boundaries[BOUNDARY_BOTTOM].type == BOUNDARY_NEUMANN) {
+            matrix[last_row*row_stride + k] = matrix[(last_row-1)*row_stride + k] + spacing*boundaries[BOUNDARY_BOTTOM].value;
+        }
+    }
+    for (int k=1 ; k<last_row ; k++) {
+        if (boundaries[BOUNDARY_LEFT].type == BOUNDARY_NEUMANN) {
+            matrix[k*row_stride] = matrix[k*row_stride + 1] + spacing*boundaries[BOUNDARY_LEFT].value;
+        }
+        if (boundaries[BOUNDARY_RIGHT].type == BOUNDARY_NEUMANN) {
+            matrix[k*row_stride + last_column] = matrix[k*row_stride + last_column-1] + spacing*boundaries[BOUNDARY_RIGHT].value;
+        }
+    }
+
+    applyNeumannCorner(0, 0, BOUNDARY_TOP, BOUNDARY_LEFT, spacing);
+    applyNeumannCorner(0, last_column, BOUNDARY_TOP, BOUNDARY_RIGHT, spacing);
+    applyNeumannCorner(last_row, 0, BOUNDARY_BOTTOM, BOUNDARY_LEFT, spacing);
+    applyNeumannCorner(last_row, last_column, BOUNDARY_BOTTOM, BOUNDARY_RIGHT, spacing);
+}
+
+// Updates matrix with the values stored in each block's new_value array, then
+// brings the Neumann sides in line with the new interior
+void updatePoissonMatrix() {
+    updateMatrix();
+    applyNeumannBoundaries();
+}
@@ -0,0 +1,324 @@
+/**
+* Worker pool
+* Oliver Redeyoff
+*
+* startPool() creates the worker threads once, when the program starts, and
+* every parallel part of the program runs on them instead of creating threads
+* of its own each time:
+*
+* - a phase runs a function once on every worker thread, which is how the
+*   barrier and MPI backends run their worker loops and how the output is
+*   formatted in the background
+* - runParallelFor() runs a task for every index of a range, with the calling
+*   thread and the worker threads each taking the next index from an atomic
+*   counter until none are left, which is how the pool backend relaxes and
+*   updates, and how grids are initialised and loaded
+* - runParallelMax() does the same and returns the largest of the tasks'
+*   results, for norms of the grid
+*
+* A phase is posted by storing its function and bumping a generation counter,
+* and ends when the count of worker threads still running it reaches 0, so
+* neither takes a lock. Between phases the worker threads check the counter
+* for a while, which keeps back to back phases cheap, and then park on a
+* condition variable until the next phase is posted, so that an idle pool
+* doesn't take CPU time from the threads which have work. The thread waiting
+* for a phase to end does the same.
+*
+* The pool belongs to one thread at a time, which reserves it. Parallel loops
+* called by any other thread, by a worker thread or while a phase is running
+* run on the calling thread alone, so they are safe to call from anywhere.
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "relaxation_technique.h"
+
+// times a waiting thread checks for a change before it parks
+#define POOL_SPIN_CHECKS 200
+
+static pthread_t* pool_threads;
+static int pool_size;
+
+// the phase being run, posted by bumping pool_generation, and the number of
+// worker threads still running it
+static void (*pool_phase)(int worker);
+static atomic_uint pool_generation;
+static atomic_int running_workers;
+static atomic_int pool_stopping;
+
+// threads parked until a phase is posted, or until it has ended
+static atomic_int parked_workers;
+static atomic_int parked_owner;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t phase_posted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t phase_ended = PTHREAD_COND_INITIALIZER;
+
+// set while the pool is reserved, and the calling thread's nested reservations
+static atomic_int pool_reserved;
+static _Thread_local int reservations;
+
+// index of the calling thread in the pool, or -1 if it isn't one of its threads
+static _Thread_local int pool_worker = -1;
+static int phase_running;
+
+// the parallel loop being run, and the largest result each thread found in it,
+// the calling thread's being first
+static void (*loop_task)(int index, void* argument);
+static double (*max_task)(int index, void* argument);
+static void* loop_argument;
+static int loop_count;
+static atomic_int next_index;
+static double* loop_maxima;
+
+// Waits for the phase after the given generation to be posted, and returns its
+// generation
+static unsigned int waitForPhase(unsigned int seen) {
+    for (int i=0 ; i<POOL_SPIN_CHECKS ; i++) {
+        unsigned int generation = atomic_load(&pool_generation);
+        if (generation != seen) {
+            return generation;
+        }
+        sched_yield();
+    }
+
+    // the poster checks for parked threads after bumping the generation, and
+    // a parking thread checks the generation after counting itself, so one of
+    // them always sees the other
+    pthread_mutex_lock(&pool_lock);
+    atomic_fetch_add(&parked_workers, 1);
+    while (atomic_load(&pool_generation) == seen) {
+        pthread_cond_wait(&phase_posted, &pool_lock);
+    }
+    atomic_fetch_sub(&parked_workers, 1);
+    pthread_mutex_unlock(&pool_lock);
+
+    return atomic_load(&pool_generation);
+}
+
+// Entry point for the pool's worker threads, which run every phase posted until
+// the pool is stopped
+static void* initPoolThread(void* vargp) {
+    int worker = (int)(long)vargp;
+    unsigned int seen = 0;
+    pool_worker = worker;
+
+    while (1) {
+        seen = waitForPhase(seen);
+        if (atomic_load(&pool_stopping)) {
+            return NULL;
+        }
+
+        pool_phase(worker);
+
+        // wake the thread waiting for the phase if this was the last one
+        if (atomic_fetch_sub(&running_workers, 1) == 1 && atomic_load(&parked_owner)) {
+            pthread_mutex_lock(&pool_lock);
+            pthread_cond_broadcast(&phase_ended);
+            pthread_mutex_unlock(&pool_lock);
+        }
+    }
+}
+
+// Posts the given phase to every worker thread
+static void postPhase(void (*phase)(int worker)) {
+    pool_phase = phase;
+    atomic_store(&running_workers, pool_size);
+    atomic_fetch_add(&pool_generation, 1);
+
+    if (atomic_load(&parked_workers) > 0) {
+        pthread_mutex_lock(&pool_lock);
+        pthread_cond_broadcast(&phase_posted);
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+// Waits for every worker thread to finish the phase posted last
+static void waitForWorkers() {
+    for (int i=0 ; i<POOL_SPIN_CHECKS ; i++) {
+        if (atomic_load(&running_workers) == 0) {
+            return;
+        }
+        sched_yield();
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    atomic_store(&parked_owner, 1);
+    while (atomic_load(&running_workers) > 0) {
+        pthread_cond_wait(&phase_ended, &pool_lock);
+    }
+    atomic_store(&parked_owner, 0);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Creates the given number of worker threads, which may be 0 to run everything
+// on the calling thread
+void startPool(int workers) {
+    pool_size = workers;
+    pool_threads = malloc((workers > 0 ? workers : 1)*sizeof(pthread_t));
+    loop_maxima = malloc((workers+1)*sizeof(double));
+    atomic_init(&pool_generation, 0);
+    atomic_init(&running_workers, 0);
+    atomic_init(&pool_stopping, 0);
+    atomic_init(&parked_workers, 0);
+    atomic_init(&parked_owner, 0);
+    atomic_init(&pool_reserved, 0);
+
+    for (int i=0 ; i<workers ; i++) {
+        pthread_create(&pool_threads[i], NULL, initPoolThread, (void*)(long)i);
+    }
+}
+
+// Ends the worker threads and waits for them
+void stopPool() {
+    atomic_store(&pool_stopping, 1);
+    postPhase(NULL);
+    for (int i=0 ; i<pool_size ; i++) {
+        pthread_join(pool_threads[i], NULL);
+    }
+    free(pool_threads);
+    free(loop_maxima);
+    pool_size = 0;
+}
+
+// Returns the index of the pool's worker thread calling it, or -1 for any other
+// thread, so that tasks can keep per thread state
+int getPoolWorker() {
+    return pool_worker;
+}
+
+// Reserves the pool for the calling thread, which may already hold it, and
+// returns 1, or returns 0 if another thread holds it or it has no worker threads
+int reservePool() {
+    if (reservations > 0) {
+        reservations++;
+        return 1;
+    }
+
+    int free_pool = 0;
+    if (pool_size > 0 && atomic_compare_exchange_strong(&pool_reserved, &free_pool, 1)) {
+        reservations = 1;
+        return 1;
+    }
+    return 0;
+}
+
+// Releases one reservation of the pool by the calling thread
+void releasePool() {
+    reservations--;
+    if (reservations == 0) {
+        atomic_store(&pool_reserved, 0);
+    }
+}
+
+// Reserves the pool for a phase and returns 1, or returns 0 if it can't be
+// reserved or is already running a phase
+static int reservePhase() {
+    if (!reservePool()) {
+        return 0;
+    }
+    if (phase_running) {
+        releasePool();
+        return 0;
+    }
+    phase_running = 1;
+    return 1;
+}
+
+// Starts running phase once on every worker thread, with the worker thread's
+// index, and returns 0, or returns 1 without running it if the pool can't be
+// reserved or is already running a phase. The caller must end the phase with
+// finishPoolPhase()
+int startPoolPhase(void (*phase)(int worker)) {
+    if (!reservePhase()) {
+        return 1;
+    }
+    postPhase(phase);
+    return 0;
+}
+
+// Waits for the phase started by startPoolPhase() to end on every worker thread
+void finishPoolPhase() {
+    waitForWorkers();
+    phase_running = 0;
+    releasePool();
+}
+
+// Runs the parallel loop being run until no indices are left, worker being -1
+// for the calling thread
+static void runLoop(int worker) {
+    double maximum = -INFINITY;
+    int index;
+
+    while ((index = atomic_fetch_add_explicit(&next_index, 1, memory_order_relaxed)) < loop_count) {
+        if (max_task != NULL) {
+            double result = max_task(index, loop_argument);
+            if (result > maximum) {
+                maximum = result;
+            }
+        } else {
+            loop_task(index, loop_argument);
+        }
+    }
+
+    loop_maxima[worker+1] = maximum;
+}
+
+// Runs the loop set up in the loop variables on the pool, which the caller has
+// reserved for it, with the calling thread taking part
+static void runPoolLoop() {
+    atomic_store(&next_index, 0);
+    postPhase(runLoop);
+    runLoop(-1);
+    finishPoolPhase();
+}
+
+// Runs task for every index from 0 to count-1, on the pool if the calling
+// thread can have it. The tasks may run in any order and at the same time
+void runParallelFor(int count, void (*task)(int index, void* argument), void* argument) {
+    if (count < 2 || !reservePhase()) {
+        for (int i=0 ; i<count ; i++) {
+            task(i, argument);
+        }
+        return;
+    }
+
+    loop_task = task;
+    max_task = NULL;
+    loop_argument = argument;
+    loop_count = count;
+    runPoolLoop();
+}
+
+// Runs task for every index from 0 to count-1 as runParallelFor() does, and
+// returns the largest of their results, or -INFINITY if count is 0
+double runParallelMax(int count, double (*task)(int index, void* argument), void* argument) {
+    double maximum = -INFINITY;
+
+    if (count < 2 || !reservePhase()) {
+        for (int i=0 ; i<count ; i++) {
+            double result = task(i, argument);
+            if (result > maximum) {
+                maximum = result;
+            }
+        }
+        return maximum;
+    }
+
+    max_task = task;
+    loop_argument = argument;
+    loop_count = count;
+    runPoolLoop();
+
+    for (int i=0 ; i<=pool_size ; i++) {
+        if (loop_maxima[i] > maximum) {
+            maximum = loop_maxima[i];
+        }
+    }
+    return maximum;
+}
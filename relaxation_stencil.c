@@ -0,0 +1,203 @@
+/**
+* Stencil kernels
+* Oliver Redeyoff
+*
+* Every kernel relaxes the interior cells of a single row of the matrix, reading
+* the row itself and the rows directly above and below it, and writes the new
+* values to a separate output row. The stencil shape and, for the common small
+* sizes, the row width are compile time constants so that the compiler can fully
+* unroll and vectorise each specialisation. selectRowKernel() picks the right
+* specialisation at runtime, and every specialisation is compiled for each
+* x86-64 ISA level (HOT_KERNEL), the best of which is picked at startup.
+*
+**/
+
+
+#include <stddef.h>
+#include <math.h>
+#include "relaxation_technique.h"
+
+// Relaxes cells 1 to width-2 of a row and returns 1 if any of them changed by
+// more than tolerance. stencil and width are constants at every call site, so
+// each caller below is compiled into its own specialised loop
+static inline __attribute__((always_inline)) int relaxRow(const int stencil, const int width,
+        const double* restrict up, const double* restrict row, const double* restrict down,
+        double* restrict out, double tolerance) {
+    int changed = 0;
+
+    for (int j=1 ; j<width-1 ; j++) {
+        double new_value;
+
+        if (stencil == STENCIL_9_POINT) {
+            // edge neighbours weigh 4 times as much as corner neighbours
+            double edge_sum = up[j] + row[j+1] + down[j] + row[j-1];
+            double corner_sum = up[j-1] + up[j+1] + down[j+1] + down[j-1];
+            new_value = (4*edge_sum + corner_sum)/20;
+        } else {
+            new_value = (up[j] + row[j+1] + down[j] + row[j-1])/4;
+        }
+
+        changed |= fabs(new_value - row[j]) > tolerance;
+        out[j] = new_value;
+    }
+
+    return changed;
+}
+
+// Defines a kernel for the given stencil which only handles rows of exactly width cells
+#define DEFINE_FIXED_ROW_KERNEL(stencil, width) \
+    HOT_KERNEL static int relaxRow##stencil##Point##width(const double* up, const double* row, const double* down, \
+            double* out, int row_width, double tolerance) { \
+        (void)row_width; \
+        return relaxRow(stencil, width, up, row, down, out, tolerance); \
+    }
+
+// Defines a kernel for the given stencil which handles rows of any width
+#define DEFINE_ROW_KERNEL(stencil) \
+    HOT_KERNEL static int relaxRow##stencil##Point(const double* up, const double* row, const double* down, \
+            double* out, int row_width, double tolerance) { \
+        return relaxRow(stencil, row_width, up, row, down, out, tolerance); \
+    }
+
+DEFINE_ROW_KERNEL(5)
+DEFINE_ROW_KERNEL(9)
+
+DEFINE_FIXED_ROW_KERNEL(5, 8)
+DEFINE_FIXED_ROW_KERNEL(5, 16)
+DEFINE_FIXED_ROW_KERNEL(5, 32)
+DEFINE_FIXED_ROW_KERNEL(5, 64)
+DEFINE_FIXED_ROW_KERNEL(5, 128)
+DEFINE_FIXED_ROW_KERNEL(5, 256)
+DEFINE_FIXED_ROW_KERNEL(9, 8)
+DEFINE_FIXED_ROW_KERNEL(9, 16)
+DEFINE_FIXED_ROW_KERNEL(9, 32)
+DEFINE_FIXED_ROW_KERNEL(9, 64)
+DEFINE_FIXED_ROW_KERNEL(9, 128)
+DEFINE_FIXED_ROW_KERNEL(9, 256)
+
+// Table of the fixed width specialisations
+static const struct {
+    int stencil;
+    int width;
+    ROW_KERNEL kernel;
+} fixed_row_kernels[] = {
+    {STENCIL_5_POINT, 8, relaxRow5Point8},
+    {STENCIL_5_POINT, 16, relaxRow5Point16},
+    {STENCIL_5_POINT, 32, relaxRow5Point32},
+    {STENCIL_5_POINT, 64, relaxRow5Point64},
+    {STENCIL_5_POINT, 128, relaxRow5Point128},
+    {STENCIL_5_POINT, 256, relaxRow5Point256},
+    {STENCIL_9_POINT, 8, relaxRow9Point8},
+    {STENCIL_9_POINT, 16, relaxRow9Point16},
+    {STENCIL_9_POINT, 32, relaxRow9Point32},
+    {STENCIL_9_POINT, 64, relaxRow9Point64},
+    {STENCIL_9_POINT, 128, relaxRow9Point128},
+    {STENCIL_9_POINT, 256, relaxRow9Point256},
+};
+
+// Returns the kernel specialised for the given stencil and row width, falling
+// back to the generic kernel for the stencil when the width has no specialisation
+ROW_KERNEL selectRowKernel(int stencil, int width) {
+    int fixed_count = sizeof(fixed_row_kernels)/sizeof(fixed_row_kernels[0]);
+
+    for (int i=0 ; i<fixed_count ; i++) {
+        if (fixed_row_kernels[i].stencil == stencil && fixed_row_kernels[i].width == width) {
+            return fixed_row_kernels[i].kernel;
+        }
+    }
+
+    if (stencil == STENCIL_9_POINT) {
+        return relaxRow9Point;
+    }
+    return relaxRow5Point;
+}
+
+// Returns 1 if the given number of points is a stencil the kernels support for
+// grids with the given number of dimensions
+int isValidStencil(int stencil, int dimensions) {
+    if (dimensions == 3) {
+        return stencil == STENCIL_7_POINT;
+    }
+    return stencil == STENCIL_5_POINT || stencil == STENCIL_9_POINT;
+}
+
+// Relaxes cells start_col to end_col-1 of a row of a volume with the 7 point
+// stencil, given the rows next to it in the same plane (north and south) and
+// the matching rows in the planes on either side (above and below), and returns
+// 1 if any of them changed by more than tolerance
+HOT_KERNEL int relaxVolumeRow(const double* restrict row, const double* restrict north, const double* restrict south,
+        const double* restrict above, const double* restrict below, double* restrict out,
+        int start_col, int end_col, double tolerance) {
+    int changed = 0;
+
+    for (int j=start_col ; j<end_col ; j++) {
+        double new_value = (north[j] + row[j+1] + south[j] + row[j-1] + above[j] + below[j])/6;
+
+        changed |= fabs(new_value - row[j]) > tolerance;
+        out[j] = new_value;
+    }
+
+    return changed;
+}
+
+// Relaxes cells 1 to width-2 of a row for the Poisson problem -div(a grad u) = f
+// and returns 1 if any of them changed by more than tolerance. source holds f for
+// the row and spacing_squared is the squared distance between cells. When
+// variable is set the diffusion coefficient a is read from the coefficient rows
+// and averaged onto the faces between cells, otherwise it is 1 everywhere
+static inline __attribute__((always_inline)) int relaxPoissonRow(const int stencil, const int variable,
+        const double* restrict up, const double* restrict row, const double* restrict down,
+        const double* restrict source, const double* restrict coefficient_up,
+        const double* restrict coefficient_row, const double* restrict coefficient_down,
+        double* restrict out, int width, double spacing_squared, double tolerance) {
+    int changed = 0;
+
+    for (int j=1 ; j<width-1 ; j++) {
+        double new_value;
+
+        if (variable) {
+            double top = (coefficient_up[j] + coefficient_row[j])/2;
+            double right = (coefficient_row[j+1] + coefficient_row[j])/2;
+            double bottom = (coefficient_down[j] + coefficient_row[j])/2;
+            double left = (coefficient_row[j-1] + coefficient_row[j])/2;
+            double weighted_sum = top*up[j] + right*row[j+1] + bottom*down[j] + left*row[j-1];
+            new_value = (weighted_sum + spacing_squared*source[j])/(top + right + bottom + left);
+        } else if (stencil == STENCIL_9_POINT) {
+            double edge_sum = up[j] + row[j+1] + down[j] + row[j-1];
+            double corner_sum = up[j-1] + up[j+1] + down[j+1] + down[j-1];
+            new_value = (4*edge_sum + corner_sum + 6*spacing_squared*source[j])/20;
+        } else {
+            new_value = (up[j] + row[j+1] + down[j] + row[j-1] + spacing_squared*source[j])/4;
+        }
+
+        changed |= fabs(new_value - row[j]) > tolerance;
+        out[j] = new_value;
+    }
+
+    return changed;
+}
+
+// Defines a Poisson kernel for the given stencil, with constant or variable coefficients
+#define DEFINE_POISSON_ROW_KERNEL(name, stencil, variable) \
+    HOT_KERNEL static int name(const double* up, const double* row, const double* down, const double* source, \
+            const double* coefficient_up, const double* coefficient_row, const double* coefficient_down, \
+            double* out, int width, double spacing_squared, double tolerance) { \
+        return relaxPoissonRow(stencil, variable, up, row, down, source, coefficient_up, coefficient_row, \
+                coefficient_down, out, width, spacing_squared, tolerance); \
+    }
+
+DEFINE_POISSON_ROW_KERNEL(relaxPoissonRow5Point, 5, 0)
+DEFINE_POISSON_ROW_KERNEL(relaxPoissonRow9Point, 9, 0)
+DEFINE_POISSON_ROW_KERNEL(relaxVariablePoissonRow5Point, 5, 1)
+
+// Returns the Poisson kernel for the given stencil, or NULL if variable
+// coefficients are asked for with a stencil that does not support them
+POISSON_ROW_KERNEL selectPoissonRowKernel(int stencil, int variable) {
+    if (variable) {
+        return stencil == STENCIL_5_POINT ? relaxVariablePoissonRow5Point : NULL;
+    }
+    if (stencil == STENCIL_9_POINT) {
+        return relaxPoissonRow9Point;
+    }
+    return relaxPoissonRow5Point;
+}
@@ -22,15 +22,26 @@
 *     and output the matrix, if not it resets value_change_flag to 0 and updates the 
 *     matrix with the new values which are stored in each temporary array
 *
+* This is the barrier backend. The sequential backend (-x sequential) runs the
+* same steps for every block on the main thread alone, so that comparing the two
+* measures the parallel strategy and nothing else. The pool backend (-x pool)
+* runs the relaxation and the update as parallel loops on the worker pool (see
+* relaxation_pool.c), whose threads the barrier backend's worker threads are too.
+*
+* The matrix is matrix_width columns by matrix_height rows, given as the size
+* argument W or WxH, with each row starting row_stride doubles after the one
+* before on a cache line (see chooseRowStride(), or -L to set the stride).
+*
 **/
 
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
-#include <sys/time.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <sched.h>
 #include <unistd.h>
 #include "relaxation_technique.h"
 
@@ -40,143 +51,250 @@ int decimal_precision;
 double decimal_value;
 int value_change_flag;
 int matrix_size;
+// columns and rows of the matrix, and the number of doubles from the start of
+// one row to the next, which pads the rows past matrix_width. In 3 dimensions
+// all three are matrix_size
+int matrix_width;
+int matrix_height;
+int row_stride;
+int stencil;
+ROW_KERNEL row_kernel;
+int dimensions;
+int in_place;
+int backend;
+// number of interior rows this process relaxes, all of them unless they are
+// distributed between MPI ranks
+int owned_rows;
 double* matrix;
 BLOCK* blocks;
 
+// the relaxation and update steps for the problem being solved, update_block
+// being an optional update step the worker threads run on their own blocks
+// after the main thread's update step
+void (*process_block)(BLOCK* block);
+void (*update_values)();
+void (*update_block)(BLOCK* block);
+
 pthread_barrier_t barrier_1;
 pthread_barrier_t barrier_2;
+pthread_barrier_t barrier_3;
 
-// Returns array of doubles of length matrix_size^2
-double* makeMatrix() {
-    // allocate memory for new matrix of given size
-    double* matrix = malloc(matrix_size*matrix_size*sizeof(double));
+// set by the main thread before releasing the worker threads from barrier 2
+// for the last time
+int solve_finished;
 
-    // put initial values in matrix
-    for (int i=0 ; i<matrix_size ; i++) {
-        for (int j=0 ; j<matrix_size ; j++){
-
-            // populate with 1.0 if left or top edge, else with 0.0
-            if (i==0 || j==0){
-                matrix[i*matrix_size + j] = 1.0;
-            } else {
-                matrix[i*matrix_size + j] = 0.0;
-            }
+// Returns the row stride for rows of width doubles: the width rounded up to
+// whole cache lines, so that every row starts on one and stays aligned for
+// vector loads, plus a line when that is a multiple of 8 lines, so that rows
+// less than 16 apart, such as the rows a kernel reads at once, never map to
+// the same cache sets, as they do when the rows are a power of two long
+int chooseRowStride(int width) {
+    int lines = (width + CACHE_LINE_DOUBLES - 1)/CACHE_LINE_DOUBLES;
+    if (lines%8 == 0) {
+        lines++;
+    }
+    return lines*CACHE_LINE_DOUBLES;
+}
 
-        }
+// Returns count zeroed elements of the given size, starting on a cache line, for
+// per thread structures padded to a cache line each, or NULL
+void* makeCacheAligned(int count, size_t size) {
+    void* elements;
+    if (posix_memalign(&elements, CACHE_LINE_DOUBLES*sizeof(double), count*size) != 0) {
+        return NULL;
     }
+    memset(elements, 0, count*size);
+    return elements;
+}
 
-    return matrix;
+// Returns array of doubles holding the given number of rows of row_stride
+// values, starting on a cache line, or NULL. Nothing is written to it, so that
+// its pages are first touched by whichever thread fills each row
+double* makeGrid(int rows) {
+    double* grid;
+    if (posix_memalign((void**)&grid, CACHE_LINE_DOUBLES*sizeof(double),
+            (size_t)rows*row_stride*sizeof(double)) != 0) {
+        return NULL;
+    }
+    return grid;
 }
 
-// Returns thread_count number of blocks which each contain a start_index, an
-// end_index and an array of doubles to store the new values that will be computed
-// between those indexes. No blocks overlap and they cover all the mutable cells of 
-// array
-BLOCK* makeBlocks() {
-    BLOCK* blocks = malloc(thread_count*sizeof(BLOCK));
+// Puts the initial values in the given row of the matrix given as argument
+static void initialiseRow(int i, void* argument) {
+    double* row = &((double*)argument)[(size_t)i*row_stride];
 
-    int mutatable_indexes_count = matrix_size*matrix_size - matrix_size*2;
+    for (int j=0 ; j<row_stride ; j++){
 
-    int equal_block_size = ceil((double)mutatable_indexes_count/(double)thread_count);
-    int last_block_size = mutatable_indexes_count%equal_block_size;
-    int equal_block_count = (mutatable_indexes_count-last_block_size) / equal_block_size;
+        // populate edges with their side's value, else with 0.0, which the
+        // padding after the row gets too
+        if (j < matrix_width && (i==0 || j==0 || i==matrix_height-1 || j==matrix_width-1)){
+            row[j] = getEdgeValue(i, j);
+        } else {
+            row[j] = 0.0;
+        }
 
-    for(int i=0 ; i<equal_block_count ; i++) {
-        BLOCK new_block;
-        new_block.start_index = matrix_size + equal_block_size*i;
-        new_block.end_index = matrix_size + equal_block_size*(i+1) - 1;
+    }
+}
 
-        double* new_values = malloc((new_block.end_index-new_block.start_index)*sizeof(double));
-        new_block.new_values = new_values;
+// Gives the first and last of the owned rows in the given block, the first
+// owned_rows%thread_count blocks taking one more row than the others
+static void getBlockRows(int i, int* start_row, int* end_row) {
+    int equal_block_rows = owned_rows/thread_count;
+    int extra_rows = owned_rows%thread_count;
 
-        blocks[i] = new_block;
-    }
+    *start_row = 1 + equal_block_rows*i + (i < extra_rows ? i : extra_rows);
+    *end_row = *start_row + equal_block_rows + (i < extra_rows ? 1 : 0) - 1;
+}
 
-    if(last_block_size != 0) {
-        BLOCK new_block;
-        new_block.start_index = matrix_size + mutatable_indexes_count - last_block_size;
-        new_block.end_index = matrix_size*matrix_size - matrix_size-1;
+// the matrix initialiseWorkerRows() puts the initial values in
+static double* initialising_matrix;
 
-        double* new_values = malloc((new_block.end_index-new_block.start_index)*sizeof(double));
-        new_block.new_values = new_values;
+// Puts the initial values in the rows of the block the given worker thread
+// relaxes, as a phase of the pool
+static void initialiseWorkerRows(int worker) {
+    int start_row, end_row;
+    getBlockRows(worker, &start_row, &end_row);
 
-        blocks[thread_count-1] = new_block;
+    for (int i=start_row ; i<=end_row ; i++) {
+        initialiseRow(i, initialising_matrix);
     }
-
-    return blocks;
 }
 
-// Returns the average of the four cells surrounding a cell at a given index
-double getSuroundingAverage(int index) {
-    double top_value = matrix[index - matrix_size];
-    double right_value = matrix[index + 1];
-    double bottom_value = matrix[index + matrix_size];
-    double left_value = matrix[index - 1];
+// Returns array of doubles holding the matrix_height rows of the matrix, or
+// NULL if it can't be allocated. The rows of each block are initialised by the
+// pool's worker thread with the same index, which is the thread relaxing them
+// with the barrier backend, so that they are first touched by it. When the pool
+// is in use or has no threads, the calling thread initialises every row
+double* makeMatrix() {
+    // allocate memory for new matrix of given size
+    double* matrix = makeGrid(matrix_height);
+    if (matrix == NULL) {
+        printf("Could not allocate the matrix\n");
+        return NULL;
+    }
+
+    // put initial values in matrix, the calling thread taking the edge rows
+    initialising_matrix = matrix;
+    if (startPoolPhase(initialiseWorkerRows) == 0) {
+        initialiseRow(0, matrix);
+        initialiseRow(matrix_height-1, matrix);
+        finishPoolPhase();
+    } else {
+        for (int i=0 ; i<matrix_height ; i++) {
+            initialiseRow(i, matrix);
+        }
+    }
 
-    return (top_value + right_value + bottom_value + left_value)/4;
+    return matrix;
 }
 
-// Performs relaxation for range indexes of matrix defined in the given block
-void processBlock(BLOCK* block) {
-    int start_index = block->start_index;
-    int end_index = block->end_index;
+// Returns thread_count number of blocks which each contain a range of whole rows,
+// given both as start_row and end_row and as a start_index and an end_index, and an
+// array of doubles to store the new values that will be computed for those rows,
+// or the buffers for relaxing those rows in place when in_place is set. No blocks
+// overlap and they cover all the mutable rows of array, with the row counts of any
+// two blocks differing by at most one
+BLOCK* makeBlocks() {
+    BLOCK* blocks = malloc(thread_count*sizeof(BLOCK));
 
-    for(int m_i=start_index ; m_i<=end_index ; m_i++) {
+    for(int i=0 ; i<thread_count ; i++) {
+        BLOCK new_block;
 
-        // get index for block new values
-        int b_i = m_i-start_index;
+        getBlockRows(i, &new_block.start_row, &new_block.end_row);
+        new_block.start_index = new_block.start_row*row_stride;
+        new_block.end_index = (new_block.end_row+1)*row_stride - 1;
+        new_block.start_plane = 0;
+        new_block.end_plane = 0;
 
-        // keep any edge value as is
-        if (m_i%matrix_size != 0 && (m_i+1)%matrix_size != 0) {
-            double new_value = getSuroundingAverage(m_i);
-            double diff = new_value - block->new_values[b_i];
-            if (diff > decimal_value) {
-                value_change_flag = 1;
-            }
-            block->new_values[b_i] = new_value;
+        new_block.row_buffers = NULL;
+        new_block.edge_rows = NULL;
+
+        if (in_place) {
+            makeInPlaceBuffers(&new_block);
         } else {
-            block->new_values[b_i] = matrix[m_i];
+            int block_rows = new_block.end_row - new_block.start_row + 1;
+            new_block.new_values = makeGrid(block_rows > 0 ? block_rows : 1);
         }
 
+        blocks[i] = new_block;
     }
 
+    return blocks;
 }
 
-// Updates matrix with values stored in each block's new_value array
-void updateMatrix() {
-    for (int i=0 ; i<thread_count ; i++) {
-        int start_index = blocks[i].start_index;
-        int end_index = blocks[i].end_index;
-
-        for(int m_i=start_index ; m_i<=end_index ; m_i++) {
-        
-            // get index for block new values
-            int b_i = m_i-start_index;
-            
-            // map block new_values to matrix values
-            if (m_i%matrix_size != 0 && (m_i+1)%matrix_size != 0) {
-                matrix[m_i] = blocks[i].new_values[b_i];
-            }
+// Performs relaxation for the rows of matrix defined in the given block, storing
+// the results in the block's new_values
+void processBlock(BLOCK* block) {
+    int changed = 0;
 
-        }
+    for(int row=block->start_row ; row<=block->end_row ; row++) {
+        double* current_row = &matrix[row*row_stride];
+        double* new_row = &block->new_values[(row-block->start_row)*row_stride];
+
+        // edge values are never written to new_row, as they are kept as is
+        changed |= row_kernel(current_row - row_stride, current_row, current_row + row_stride,
+                new_row, matrix_width, decimal_value);
+    }
+
+    if (changed) {
+        value_change_flag = 1;
     }
 }
 
+// Starts counting hardware events for a task of a parallel loop on the thread
+// running it, 0 being the calling thread and the pool's worker thread w being
+// w+1, and returns the thread, or -1 if the events aren't counted
+static int beginTaskCounting() {
+    if (!perf_enabled) {
+        return -1;
+    }
+    int thread = getPoolWorker() + 1;
+    if (!isCountingHardware(thread)) {
+        startHardwareCounters(thread);
+    }
+    beginHardwarePhase(thread);
+    return thread;
+}
+
+// Ends counting hardware events for a task started with beginTaskCounting()
+static void endTaskCounting(int thread) {
+    if (thread != -1) {
+        endHardwarePhase(thread);
+    }
+}
+
+// Copies the new values of the given block to matrix, skipping the edge columns
+static void updateBlockRows(int i, void* argument) {
+    int counting_thread = beginTaskCounting();
+    for(int row=blocks[i].start_row ; row<=blocks[i].end_row ; row++) {
+        double* new_row = &blocks[i].new_values[(row-blocks[i].start_row)*row_stride];
+        memcpy(&matrix[row*row_stride + 1], &new_row[1], (matrix_width-2)*sizeof(double));
+    }
+    endTaskCounting(counting_thread);
+}
+
+// Updates matrix with values stored in each block's new_value array, on the
+// worker pool when it is free, which it isn't while the barrier backend's
+// worker threads are running
+void updateMatrix() {
+    runParallelFor(thread_count, updateBlockRows, NULL);
+}
+
 // Prints out matrix as table, and highlights each block
 void printMatrixBlocks() {
     char colors[6][20] = {"\033[0;31m", "\033[0;32m", "\033[0;33m", "\033[0;34m", "\033[0;35m", "\033[0;36m"};
 
-    for (int i=0 ; i<matrix_size ; i++) {
+    for (int i=0 ; i<matrix_height ; i++) {
         printf("\n");
-        for (int j=0 ; j<matrix_size ; j++){
-            int index = i*matrix_size + j;
+        for (int j=0 ; j<matrix_width ; j++){
+            int index = i*row_stride + j;
 
             for(int q=0 ; q<thread_count ; q++) {
                 if(index >= blocks[q].start_index && index <= blocks[q].end_index) {
                     printf("%s", colors[q%5]);
                 }
             }
-            printf("%f\033[0m, ", matrix[i*matrix_size + j]);
+            printf("%f\033[0m, ", matrix[index]);
         }
     }
     printf("\n\n");
@@ -196,105 +314,766 @@ void printBlocks() {
 // Entry point for worker thread
 void* initWorkerThread(void* vargp) {
     BLOCK* block = (BLOCK*)vargp;
+    int thread = block - blocks;
+#ifdef RELAXATION_INSTRUMENT
+    long long block_cells = getBlockCells(block);
+#endif
+    // the pool's threads keep their counters from one solve to the next
+    if (perf_enabled && !isCountingHardware(thread+1)) {
+        startHardwareCounters(thread+1);
+    }
 
     // worker thread loop
     while (1) {
         // perform relaxation on given block
-        processBlock(block);
+        PHASE_TIME(compute_start);
+        if (perf_enabled) {
+            beginHardwarePhase(thread+1);
+        }
+        process_block(block);
+        if (perf_enabled) {
+            endHardwarePhase(thread+1);
+        }
+        PHASE_TIME(compute_end);
+        INSTRUMENT_ADD(thread, compute_nanoseconds, compute_end - compute_start);
+        INSTRUMENT_ADD(thread, cells_updated, block_cells);
+        INSTRUMENT_ADD(thread, iterations, 1);
+        TRACE_PHASE(thread+1, TRACE_SWEEP, compute_start, compute_end);
 
         // wait to synchronise with main and other work threads at barrier 1
         pthread_barrier_wait(&barrier_1);
 
-        // wait to synchronise with main and other work threads at barrier 2
+        // wait to synchronise with main and other work threads at barrier 2,
+        // after which the main thread may have ended the solve
         pthread_barrier_wait(&barrier_2);
+        if (solve_finished) {
+            return NULL;
+        }
+        PHASE_TIME(wait_end);
+        INSTRUMENT_ADD(thread, wait_nanoseconds, wait_end - compute_end);
+        TRACE_PHASE(thread+1, TRACE_BARRIER_WAIT, compute_end, wait_end);
+
+        // perform the update step on given block if there is one, and wait for
+        // all other work threads to finish theirs at barrier 3
+        if (update_block != NULL) {
+            if (perf_enabled) {
+                beginHardwarePhase(thread+1);
+            }
+            update_block(block);
+            if (perf_enabled) {
+                endHardwarePhase(thread+1);
+            }
+            PHASE_TIME(update_end);
+            pthread_barrier_wait(&barrier_3);
+            PHASE_TIME(update_wait_end);
+
+            INSTRUMENT_ADD(thread, compute_nanoseconds, update_end - wait_end);
+            INSTRUMENT_ADD(thread, wait_nanoseconds, update_wait_end - update_end);
+            TRACE_PHASE(thread+1, TRACE_BLOCK_UPDATE, wait_end, update_end);
+            TRACE_PHASE(thread+1, TRACE_BARRIER_WAIT, update_end, update_wait_end);
+        }
     }
 }
 
-double getTimeTaken(struct timeval start_time, struct timeval end_time) {
-    double res = (end_time.tv_sec - start_time.tv_sec) * 1e6;
-    res = (res + (end_time.tv_usec - start_time.tv_usec)) * 1e-6;
-    return res;
+// Runs the worker thread loop for the block of the given worker thread of the
+// pool, as a phase of the pool
+void runBlockWorker(int worker) {
+    initWorkerThread(&blocks[worker]);
 }
 
-int main(int argc, char **argv) {
-
-    // set global variables to passed values
-    if (argc != 4) {
-        printf("Too few arguments\n");
-        return 1;
+// Applies the sweep which ended the solve, which in place relaxation has already
+// written to the matrix, so that the copying scheme ends with the same matrix.
+// The worker threads are waiting at barrier 2 or done, so the main thread runs
+// any block update step itself
+void applyFinalSweep() {
+    update_values();
+    if (update_block != NULL) {
+        for (int i=0 ; i<thread_count ; i++) {
+            update_block(&blocks[i]);
+        }
     }
-    matrix_size = atoi(argv[1]);
-    thread_count = atoi(argv[2]);
-    decimal_precision = atoi(argv[3]);
-    decimal_value = pow(0.1, decimal_precision);
-
-    pthread_t threads[thread_count];
+}
 
-    struct timeval start, end;
-    double time_taken;
-    struct timeval parallel_start, parallel_end;
-    double parallel_time_taken;
-    struct timeval sequential_start, sequential_end;
-    double sequential_time_taken;
-  
-    // start timer
-    gettimeofday(&start, NULL);
+// Returns the number of seconds between two times read from the monotonic clock
+double getTimeTaken(struct timespec start_time, struct timespec end_time) {
+    double res = (end_time.tv_sec - start_time.tv_sec) * 1e9;
+    res = (res + (end_time.tv_nsec - start_time.tv_nsec)) * 1e-9;
+    return res;
+}
 
-    // instantiate matrix
-    matrix = makeMatrix();
-    // instantiate blocks
-    blocks = makeBlocks();
+// Runs the pthread barrier backend, in which a worker thread per block performs
+// the relaxation while the main thread checks for convergence and updates the
+// values between barriers. Adds the time spent in each part to the given totals
+// and returns the number of iterations
+long long solveWithBarriers(double* sequential_time_taken, double* parallel_time_taken) {
+    struct timespec parallel_start, parallel_end;
+    struct timespec sequential_start, sequential_end;
+    long long iterations = 0;
 
     // initialise barriers
     pthread_barrier_init(&barrier_1, NULL, thread_count+1);
     pthread_barrier_init(&barrier_2, NULL, thread_count+1);
+    pthread_barrier_init(&barrier_3, NULL, thread_count+1);
 
-    value_change_flag = 0;
-
-    // create threads
-    for (int i=0 ; i<thread_count ; i++) {
-        pthread_create(&threads[i], NULL, initWorkerThread, (void*)&blocks[i]);
+    // run a worker thread per block on the pool, which a checkpoint being
+    // written may still be using
+    solve_finished = 0;
+    while (startPoolPhase(runBlockWorker)) {
+        sched_yield();
     }
 
     while (1) {
 
         // wait to synchronise with the worker threads at barrier 1
-        gettimeofday(&parallel_start, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &parallel_start);
+        PHASE_TIME(wait_start);
         pthread_barrier_wait(&barrier_1);
-        gettimeofday(&parallel_end, NULL);
-        parallel_time_taken += getTimeTaken(parallel_start, parallel_end);
+        PHASE_TIME(wait_end);
+        clock_gettime(CLOCK_MONOTONIC, &parallel_end);
+        *parallel_time_taken += getTimeTaken(parallel_start, parallel_end);
+        TRACE_PHASE(0, TRACE_BARRIER_WAIT, wait_start, wait_end);
 
-        gettimeofday(&sequential_start, NULL);
-        // check if no value has been changed, if so end program, if not
-        // reset the value_change_flag to 0
-        if (value_change_flag == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &sequential_start);
+        // check if no value has been changed or the job was cancelled, if so
+        // end program, if not reset the value_change_flag to 0
+        if (value_change_flag == 0 || isJobCancelled()) {
+            applyFinalSweep();
             break;
         } else {
             value_change_flag = 0;
         }
+        PHASE_TIME(check_end);
+        TRACE_PHASE(0, TRACE_CONVERGENCE_CHECK, wait_end, check_end);
 
         // update matrix with the new values contained in the temporary arrays
-        updateMatrix();
+        if (perf_enabled) {
+            beginHardwarePhase(0);
+        }
+        update_values();
+        if (perf_enabled) {
+            endHardwarePhase(0);
+        }
+        iterations++;
+        if (update_block == NULL) {
+            serviceJob(iterations);
+        }
+        PHASE_TIME(update_end);
+        TRACE_PHASE(0, TRACE_UPDATE, check_end, update_end);
 
         // system("clear");
         // printMatrixBlocks();
         // usleep(100000);
 
         // wait to synchronise with worker threads at barrier 2
-        gettimeofday(&sequential_end, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &sequential_end);
         pthread_barrier_wait(&barrier_2);
-        sequential_time_taken += getTimeTaken(sequential_start, sequential_end);
+        PHASE_TIME(release_end);
+        *sequential_time_taken += getTimeTaken(sequential_start, sequential_end);
+        INSTRUMENT_ADD(thread_count, compute_nanoseconds, (long long)(getTimeTaken(sequential_start, sequential_end)*1e9));
+        TRACE_PHASE(0, TRACE_BARRIER_WAIT, update_end, release_end);
+
+        // wait for the worker threads to finish their update step at barrier 3
+        if (update_block != NULL) {
+            clock_gettime(CLOCK_MONOTONIC, &parallel_start);
+            pthread_barrier_wait(&barrier_3);
+            clock_gettime(CLOCK_MONOTONIC, &parallel_end);
+            *parallel_time_taken += getTimeTaken(parallel_start, parallel_end);
+            PHASE_TIME(update_wait_end);
+            TRACE_PHASE(0, TRACE_BARRIER_WAIT, release_end, update_wait_end);
+
+            // the worker threads only read the grid while relaxing, so the
+            // iterate is complete until the next update
+            serviceJob(iterations);
+        }
 
     }
 
+    // release the worker threads from barrier 2 to end, so that the pool is
+    // free for whatever follows the solve
+    solve_finished = 1;
+    pthread_barrier_wait(&barrier_2);
+    finishPoolPhase();
+    pthread_barrier_destroy(&barrier_1);
+    pthread_barrier_destroy(&barrier_2);
+    pthread_barrier_destroy(&barrier_3);
+
+    return iterations;
+}
+
+// Runs the sequential backend, in which the main thread performs the relaxation
+// of every block itself with the same steps as the worker threads would, so
+// that its time is the baseline the parallel backends are measured against.
+// The relaxation counts as the parallel part and the convergence check and
+// update as the sequential part. Returns the number of iterations
+long long solveSequentially(double* sequential_time_taken, double* parallel_time_taken) {
+    struct timespec parallel_start, parallel_end;
+    struct timespec sequential_start, sequential_end;
+    long long iterations = 0;
+
+    while (1) {
+
+        // perform relaxation on every block
+        clock_gettime(CLOCK_MONOTONIC, &parallel_start);
+        PHASE_TIME(compute_start);
+        if (perf_enabled) {
+            beginHardwarePhase(0);
+        }
+        // count each block's work against the thread that would run it
+        for (int i=0 ; i<thread_count ; i++) {
+#ifdef RELAXATION_INSTRUMENT
+            PHASE_TIME(block_start);
+            process_block(&blocks[i]);
+            PHASE_TIME(block_end);
+            INSTRUMENT_ADD(i, compute_nanoseconds, block_end - block_start);
+            INSTRUMENT_ADD(i, cells_updated, getBlockCells(&blocks[i]));
+            INSTRUMENT_ADD(i, iterations, 1);
+#else
+            process_block(&blocks[i]);
+#endif
+        }
+        if (perf_enabled) {
+            endHardwarePhase(0);
+        }
+        PHASE_TIME(compute_end);
+        clock_gettime(CLOCK_MONOTONIC, &parallel_end);
+        *parallel_time_taken += getTimeTaken(parallel_start, parallel_end);
+        TRACE_PHASE(0, TRACE_SWEEP, compute_start, compute_end);
+
+        clock_gettime(CLOCK_MONOTONIC, &sequential_start);
+        // check if no value has been changed or the job was cancelled, if so
+        // end program, if not reset the value_change_flag to 0
+        if (value_change_flag == 0 || isJobCancelled()) {
+            applyFinalSweep();
+            break;
+        } else {
+            value_change_flag = 0;
+        }
+        PHASE_TIME(check_end);
+        TRACE_PHASE(0, TRACE_CONVERGENCE_CHECK, compute_end, check_end);
+
+        // update matrix with the new values contained in the temporary arrays
+        if (perf_enabled) {
+            beginHardwarePhase(0);
+        }
+        update_values();
+        if (update_block != NULL) {
+            for (int i=0 ; i<thread_count ; i++) {
+                update_block(&blocks[i]);
+            }
+        }
+        if (perf_enabled) {
+            endHardwarePhase(0);
+        }
+        iterations++;
+        serviceJob(iterations);
+        PHASE_TIME(update_end);
+        clock_gettime(CLOCK_MONOTONIC, &sequential_end);
+        *sequential_time_taken += getTimeTaken(sequential_start, sequential_end);
+        INSTRUMENT_ADD(thread_count, compute_nanoseconds, update_end - compute_end);
+        TRACE_PHASE(0, TRACE_UPDATE, check_end, update_end);
+
+    }
+
+    return iterations;
+}
+
+// Relaxes the given block, as a task of the pool backend. The block's wait is
+// the rest of the loop it runs in, which addLoopWait() adds once the loop is
+// over, so the time spent relaxing it is taken off here
+static void processBlockTask(int i, void* argument) {
+    int counting_thread = beginTaskCounting();
+    PHASE_TIME(block_start);
+    process_block(&blocks[i]);
+    PHASE_TIME(block_end);
+    endTaskCounting(counting_thread);
+    INSTRUMENT_ADD(i, compute_nanoseconds, block_end - block_start);
+    INSTRUMENT_ADD(i, wait_nanoseconds, block_start - block_end);
+    INSTRUMENT_ADD(i, cells_updated, getBlockCells(&blocks[i]));
+    INSTRUMENT_ADD(i, iterations, 1);
+    TRACE_PHASE(i+1, TRACE_SWEEP, block_start, block_end);
+}
+
+// Runs the block update step on the given block, as a task of the pool backend,
+// with its wait counted as processBlockTask() counts it
+static void updateBlockTask(int i, void* argument) {
+    int counting_thread = beginTaskCounting();
+    PHASE_TIME(update_start);
+    update_block(&blocks[i]);
+    PHASE_TIME(update_end);
+    endTaskCounting(counting_thread);
+    INSTRUMENT_ADD(i, compute_nanoseconds, update_end - update_start);
+    INSTRUMENT_ADD(i, wait_nanoseconds, update_start - update_end);
+    TRACE_PHASE(i+1, TRACE_BLOCK_UPDATE, update_start, update_end);
+}
+
+#ifdef RELAXATION_INSTRUMENT
+// Adds the length of a parallel loop of the pool backend to every block's wait,
+// which with the time its task took off leaves the time it spent waiting for
+// the loop's slowest task
+static void addLoopWait(long long loop_start, long long loop_end) {
+    for (int i=0 ; i<thread_count ; i++) {
+        INSTRUMENT_ADD(i, wait_nanoseconds, loop_end - loop_start);
+    }
+}
+#endif
+
+// Runs the pool backend, in which the calling thread and the worker pool share
+// each iteration's relaxation of the blocks, and then its update, as parallel
+// loops, so that no thread waits out a sequential update step. Blocks go to
+// whichever thread is free, so their counters and trace events are kept per
+// block, a block's wait being the part of each loop it wasn't running in, while
+// hardware events are counted per thread. The relaxation and update count as
+// the parallel part and the convergence check as the sequential part. Returns
+// the number of iterations
+long long solveWithPool(double* sequential_time_taken, double* parallel_time_taken) {
+    struct timespec parallel_start, parallel_end;
+    struct timespec sequential_start, sequential_end;
+    long long iterations = 0;
+
+    // hold the pool for the whole solve, so that a checkpoint doesn't take it
+    // between iterations
+    reservePool();
+
+    while (1) {
+
+        // perform relaxation on every block
+        clock_gettime(CLOCK_MONOTONIC, &parallel_start);
+#ifdef RELAXATION_INSTRUMENT
+        PHASE_TIME(sweep_start);
+        runParallelFor(thread_count, processBlockTask, NULL);
+        PHASE_TIME(sweep_end);
+        addLoopWait(sweep_start, sweep_end);
+#else
+        runParallelFor(thread_count, processBlockTask, NULL);
+#endif
+        clock_gettime(CLOCK_MONOTONIC, &parallel_end);
+        *parallel_time_taken += getTimeTaken(parallel_start, parallel_end);
+
+        clock_gettime(CLOCK_MONOTONIC, &sequential_start);
+        PHASE_TIME(check_start);
+        // check if no value has been changed or the job was cancelled, if so
+        // end program, if not reset the value_change_flag to 0
+        if (value_change_flag == 0 || isJobCancelled()) {
+            applyFinalSweep();
+            break;
+        } else {
+            value_change_flag = 0;
+        }
+        PHASE_TIME(check_end);
+        clock_gettime(CLOCK_MONOTONIC, &sequential_end);
+        *sequential_time_taken += getTimeTaken(sequential_start, sequential_end);
+        INSTRUMENT_ADD(thread_count, compute_nanoseconds, check_end - check_start);
+        TRACE_PHASE(0, TRACE_CONVERGENCE_CHECK, check_start, check_end);
+
+        // update matrix with the new values, which the update steps spread
+        // over the pool themselves
+        clock_gettime(CLOCK_MONOTONIC, &parallel_start);
+        if (perf_enabled) {
+            beginHardwarePhase(0);
+        }
+        update_values();
+        if (perf_enabled) {
+            endHardwarePhase(0);
+        }
+        if (update_block != NULL) {
+#ifdef RELAXATION_INSTRUMENT
+            PHASE_TIME(block_update_start);
+            runParallelFor(thread_count, updateBlockTask, NULL);
+            PHASE_TIME(block_update_end);
+            addLoopWait(block_update_start, block_update_end);
+#else
+            runParallelFor(thread_count, updateBlockTask, NULL);
+#endif
+        }
+        iterations++;
+        serviceJob(iterations);
+        PHASE_TIME(update_end);
+        clock_gettime(CLOCK_MONOTONIC, &parallel_end);
+        *parallel_time_taken += getTimeTaken(parallel_start, parallel_end);
+        TRACE_PHASE(0, TRACE_UPDATE, check_end, update_end);
+
+    }
+
+    releasePool();
+    return iterations;
+}
+
+// Runs the selected backend, adding the time spent in each part to the given
+// totals, and returns the number of iterations
+long long solveWithBackend(double* sequential_time_taken, double* parallel_time_taken) {
+    if (backend == BACKEND_SEQUENTIAL) {
+        return solveSequentially(sequential_time_taken, parallel_time_taken);
+    } else if (backend == BACKEND_MPI) {
+        return solveDistributed(sequential_time_taken, parallel_time_taken);
+    } else if (backend == BACKEND_POOL) {
+        return solveWithPool(sequential_time_taken, parallel_time_taken);
+    }
+    return solveWithBarriers(sequential_time_taken, parallel_time_taken);
+}
+
+int main(int argc, char **argv) {
+
+    // read options, which may appear anywhere among the positional arguments
+    stencil = 0;
+    dimensions = 2;
+    int decomposition = -1;
+    char* source_argument = NULL;
+    char* coefficient_argument = NULL;
+    char* trace_file = NULL;
+    char* input_file = NULL;
+    char* output_file = NULL;
+    int count_hardware = 0;
+    double progress_interval = 0;
+    double time_limit = 0;
+    double checkpoint_interval = 0;
+    char* checkpoint_file = NULL;
+    int nested_levels = 0;
+    int requested_stride = 0;
+    backend = BACKEND_BARRIER;
+    int option;
+    while ((option = getopt(argc, argv, "k:d:D:b:r:c:a:it:PB:x:f:o:p:T:qC:M:L:")) != -1) {
+        switch (option) {
+        case 'k':
+            stencil = atoi(optarg);
+            break;
+        case 'd':
+            dimensions = atoi(optarg);
+            if (dimensions != 2 && dimensions != 3) {
+                printf("Unsupported number of dimensions '%s', use 2 or 3\n", optarg);
+                return 1;
+            }
+            break;
+        case 'D':
+            if (strcmp(optarg, "slab") == 0) {
+                decomposition = DECOMPOSITION_SLAB;
+            } else if (strcmp(optarg, "pencil") == 0) {
+                decomposition = DECOMPOSITION_PENCIL;
+            } else {
+                printf("Unsupported decomposition '%s', use slab or pencil\n", optarg);
+                return 1;
+            }
+            break;
+        case 'b':
+            if (parseBoundaries(optarg)) {
+                return 1;
+            }
+            break;
+        case 'r':
+            source_argument = optarg;
+            break;
+        case 'c':
+            coefficient_argument = optarg;
+            break;
+        case 'i':
+            in_place = 1;
+            break;
+        case 't':
+            trace_file = optarg;
+            break;
+        case 'P':
+            count_hardware = 1;
+            break;
+        case 'x':
+            if (strcmp(optarg, "sequential") == 0) {
+                backend = BACKEND_SEQUENTIAL;
+            } else if (strcmp(optarg, "barrier") == 0) {
+                backend = BACKEND_BARRIER;
+            } else if (strcmp(optarg, "mpi") == 0) {
+                backend = BACKEND_MPI;
+            } else if (strcmp(optarg, "pool") == 0) {
+                backend = BACKEND_POOL;
+            } else {
+                printf("Unsupported backend '%s', use sequential, barrier, pool or mpi\n", optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            input_file = optarg;
+            break;
+        case 'o':
+            output_file = optarg;
+            break;
+        case 'p':
+            progress_interval = atof(optarg);
+            break;
+        case 'T':
+            time_limit = atof(optarg);
+            break;
+        case 'M':
+            nested_levels = atoi(optarg);
+            if (nested_levels < 0) {
+                printf("Unsupported number of levels '%s', use 0 or more\n", optarg);
+                return 1;
+            }
+            break;
+        case 'L':
+            requested_stride = atoi(optarg);
+            break;
+        case 'q':
+            quantise_output = 1;
+            break;
+        case 'C':
+            checkpoint_interval = strtod(optarg, &checkpoint_file);
+            if (*checkpoint_file != ':' || checkpoint_interval <= 0) {
+                printf("Unsupported checkpoint '%s', use seconds:file\n", optarg);
+                return 1;
+            }
+            checkpoint_file++;
+            break;
+        case 'B':
+            // calibration replaces the solve
+            return calibrateBandwidth(atoi(optarg));
+        case 'a':
+            if (parseAcceleration(optarg)) {
+                printf("Unsupported acceleration '%s', use chebyshev or anderson[:depth]\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            return 1;
+        }
+    }
+
+    // default to the smallest stencil for the number of dimensions
+    if (stencil == 0) {
+        stencil = dimensions == 3 ? STENCIL_7_POINT : STENCIL_5_POINT;
+    }
+    if (!isValidStencil(stencil, dimensions)) {
+        printf("Unsupported stencil '%d' for %d dimensions, use %s\n", stencil, dimensions, dimensions == 3 ? "7" : "5 or 9");
+        return 1;
+    }
+    int poisson = source_argument != NULL || coefficient_argument != NULL;
+    if (dimensions == 3 && (poisson || hasNeumannBoundaries())) {
+        printf("Poisson problems and Neumann boundaries are only supported in 2 dimensions\n");
+        return 1;
+    }
+    if (dimensions == 3 && acceleration != ACCELERATION_NONE) {
+        printf("Acceleration is only supported in 2 dimensions\n");
+        return 1;
+    }
+    if (dimensions == 3 && input_file != NULL) {
+        printf("Input files are only supported in 2 dimensions\n");
+        return 1;
+    }
+    if (in_place && (dimensions == 3 || acceleration != ACCELERATION_NONE)) {
+        printf("In place relaxation is only supported in 2 dimensions without acceleration\n");
+        return 1;
+    }
+
+    if (nested_levels > 0 && (dimensions == 3 || backend == BACKEND_MPI || input_file != NULL)) {
+        printf("Nested iteration is only supported in 2 dimensions, without MPI or an input file\n");
+        return 1;
+    }
+    if (backend == BACKEND_MPI && checkpoint_file != NULL) {
+        printf("Checkpoints are not supported by the MPI backend\n");
+        return 1;
+    }
+    if (backend == BACKEND_MPI && (dimensions == 3 || in_place || acceleration != ACCELERATION_NONE ||
+            hasNeumannBoundaries())) {
+        printf("The MPI backend only supports 2 dimensions with Dirichlet boundaries, without in place relaxation or acceleration\n");
+        return 1;
+    }
+
+    // set global variables to passed values
+    if (argc - optind != 3) {
+        printf("Too few arguments\n");
+        return 1;
+    }
+    // the size is either a number for a square, or widthxheight
+    char* size_argument = argv[optind];
+    char size_separator;
+    int rectangle = strchr(size_argument, 'x') != NULL;
+    int size_fields = rectangle ?
+            sscanf(size_argument, "%dx%d%c", &matrix_width, &matrix_height, &size_separator) :
+            sscanf(size_argument, "%d%c", &matrix_width, &size_separator);
+    if (!rectangle && size_fields == 1) {
+        matrix_height = matrix_width;
+    } else if (!rectangle || size_fields != 2) {
+        printf("Unsupported size '%s', use size or widthxheight\n", size_argument);
+        return 1;
+    }
+    if (matrix_width < 3 || matrix_height < 3) {
+        printf("The matrix needs at least 3 columns and 3 rows\n");
+        return 1;
+    }
+    if (dimensions == 3 && (matrix_width != matrix_height || requested_stride != 0)) {
+        printf("Volumes are cubes without padded rows, use a single size\n");
+        return 1;
+    }
+    if (requested_stride != 0 && requested_stride < matrix_width) {
+        printf("The row stride can't be less than the width\n");
+        return 1;
+    }
+    matrix_size = matrix_width;
+    row_stride = dimensions == 3 ? matrix_size :
+            requested_stride != 0 ? requested_stride : chooseRowStride(matrix_width);
+    thread_count = atoi(argv[optind+1]);
+    if (thread_count < 1) {
+        printf("There must be at least 1 thread\n");
+        return 1;
+    }
+    decimal_precision = atoi(argv[optind+2]);
+    decimal_value = pow(0.1, decimal_precision);
+    row_kernel = selectRowKernel(stencil, matrix_width);
+    owned_rows = matrix_height - 2;
+
+    if (backend == BACKEND_MPI && startDistribution(&argc, &argv)) {
+        return 1;
+    }
+
+    struct timespec start, end;
+    double time_taken;
+    double parallel_time_taken = 0;
+    double sequential_time_taken = 0;
+    long long iterations = 0;
+  
+    // start timer
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // start the worker threads which every parallel step runs on, leaving the
+    // sequential backend, the baseline, with none
+    startPool(backend == BACKEND_SEQUENTIAL ? 0 : thread_count);
+
+#ifdef RELAXATION_INSTRUMENT
+    makeWorkerCounters();
+#endif
+
+    // solve on coarser grids first for the fine grid's initial guess
+    if (nested_levels > 0 && solveCoarseLevels(nested_levels, stencil, source_argument, coefficient_argument,
+            &sequential_time_taken, &parallel_time_taken)) {
+        return 1;
+    }
+
+    if (dimensions == 3) {
+        // use slabs unless there are more threads than planes to share
+        if (decomposition == -1) {
+            decomposition = thread_count > matrix_size-2 ? DECOMPOSITION_PENCIL : DECOMPOSITION_SLAB;
+        }
+
+        // instantiate both volumes and blocks
+        volume = makeVolume();
+        next_volume = makeVolume();
+        blocks = makeVolumeBlocks(decomposition);
+
+        process_block = processVolumeBlock;
+        update_values = updateVolume;
+    } else {
+        // instantiate matrix, from the input file or the coarse levels if there
+        // are any, with any Neumann sides in line with its interior. With the MPI
+        // backend it only holds this rank's rows
+        if (backend == BACKEND_MPI) {
+            if (setUpDistributedMatrix(input_file)) {
+                return 1;
+            }
+        } else {
+            matrix = input_file != NULL ? loadGrid(input_file) : makeMatrix();
+            if (matrix == NULL) {
+                return 1;
+            }
+            interpolateCoarseSolution();
+        }
+        if (hasNeumannBoundaries()) {
+            applyNeumannBoundaries();
+        }
+        // instantiate blocks
+        blocks = makeBlocks();
+
+        // only use the Poisson kernels and boundary updates when the problem needs
+        // them, so that the Laplace problem keeps its own kernels
+        process_block = processBlock;
+        update_values = updateMatrix;
+        if (poisson) {
+            if (setUpPoisson(source_argument, coefficient_argument, stencil)) {
+                return 1;
+            }
+            process_block = processPoissonBlock;
+            if (backend == BACKEND_MPI) {
+                source = getRankGrid(source);
+                coefficients = getRankGrid(coefficients);
+            }
+        }
+        if (hasNeumannBoundaries()) {
+            update_values = updatePoissonMatrix;
+        }
+        if (in_place) {
+            process_block = processInPlaceBlock;
+            update_values = updateInPlace;
+        }
+        if (setUpAcceleration(stencil)) {
+            return 1;
+        }
+    }
+
+    value_change_flag = 0;
+    if (trace_file != NULL) {
+        startTrace();
+    }
+    if (count_hardware) {
+        makeHardwareCounters();
+    }
+
+    // solve with the selected backend as a job, watching over it if asked to
+    if (startJob()) {
+        printf("Could not start the solve\n");
+        return 1;
+    }
+    monitorJob(progress_interval, time_limit, checkpoint_interval, checkpoint_file);
+    // the roofline and the hardware counters describe the fine grid's solve
+    // alone, so its time is kept apart from the coarse levels'
+    double fine_sequential_time_taken = 0;
+    double fine_parallel_time_taken = 0;
+    iterations = waitForJob(&fine_sequential_time_taken, &fine_parallel_time_taken);
+    sequential_time_taken += fine_sequential_time_taken;
+    parallel_time_taken += fine_parallel_time_taken;
+    if (count_hardware) {
+        stopHardwareCounters();
+    }
+
     // end timer
-    gettimeofday(&end, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
   
     // calculate total time taken by the program
     time_taken = getTimeTaken(start, end);
     
+    // start writing the result, which every rank shares with the MPI backend,
+    // in the background while the results are reported
+    if (backend == BACKEND_MPI && gatherMatrix()) {
+        printf("Could not gather the matrix\n");
+        return 1;
+    }
+    int writing = 0;
+    if (rank == 0 && output_file != NULL) {
+        if (startOutput(output_file, dimensions == 3 ? volume : matrix, quantise_output ? decimal_value : 0)) {
+            return 1;
+        }
+        writing = 1;
+    }
+
     // print results
-    printf("%d, %f, %f, %f\n", matrix_size, time_taken, sequential_time_taken, parallel_time_taken);
+    if (rank == 0) {
+        printf("%s, %f, %f, %f\n", size_argument, time_taken, sequential_time_taken, parallel_time_taken);
+#ifdef RELAXATION_INSTRUMENT
+        printWorkerCounters();
+#endif
+        printRoofline(fine_sequential_time_taken + fine_parallel_time_taken, iterations);
+        if (count_hardware) {
+            printHardwareCounters(fine_sequential_time_taken + fine_parallel_time_taken, iterations);
+        }
+        if (trace_file != NULL && writeTrace(trace_file)) {
+            return 1;
+        }
+    }
+    if (backend == BACKEND_MPI) {
+        endDistribution();
+    }
+    int output_failed = writing && finishOutput();
+    stopPool();
+    if (output_failed) {
+        return 1;
+    }
+    if (isJobCancelled()) {
+        return 2;
+    }
 
     return 0;
 }
\ No newline at end of file
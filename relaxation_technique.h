@@ -1,15 +1,309 @@
+#include <time.h>
+
 typedef struct block {
     int start_index;
     int end_index;
+    int start_row;
+    int end_row;
+    int start_plane;
+    int end_plane;
     double* new_values;
+    double* row_buffers;
+    double* edge_rows;
 } BLOCK;
 
+// doubles in a cache line, which rows of the matrix are padded to a multiple of
+#define CACHE_LINE_DOUBLES 8
+
+// stencil shapes supported by the kernels, named after their number of points
+#define STENCIL_5_POINT 5
+#define STENCIL_7_POINT 7
+#define STENCIL_9_POINT 9
+
+// ways of splitting a volume between threads
+#define DECOMPOSITION_SLAB 0
+#define DECOMPOSITION_PENCIL 1
+
+// kinds of condition a side of the matrix can have
+#define BOUNDARY_DIRICHLET 0
+#define BOUNDARY_NEUMANN 1
+
+// sides of the matrix, in the order they take precedence at the corners
+#define BOUNDARY_TOP 0
+#define BOUNDARY_LEFT 1
+#define BOUNDARY_BOTTOM 2
+#define BOUNDARY_RIGHT 3
+
+typedef struct boundary {
+    int type;
+    double value;
+} BOUNDARY;
+
+// accelerations of the Jacobi iteration
+#define ACCELERATION_NONE 0
+#define ACCELERATION_CHEBYSHEV 1
+#define ACCELERATION_ANDERSON 2
+
+// backends running the relaxation, all sharing the same kernels, set up and I/O
+#define BACKEND_SEQUENTIAL 0
+#define BACKEND_BARRIER 1
+#define BACKEND_MPI 2
+#define BACKEND_POOL 3
+
+// states of a solve job
+#define JOB_RUNNING 0
+#define JOB_CONVERGED 1
+#define JOB_CANCELLED 2
+
+// progress of a solve job. residual is the largest change of a cell in the last
+// iteration measured, convergence_rate the factor it shrinks by per iteration
+// and eta the estimated number of seconds left, each -1 until known
+typedef struct job_progress {
+    int state;
+    long long iterations;
+    double elapsed;
+    double residual;
+    double convergence_rate;
+    double eta;
+} JOB_PROGRESS;
+
+// header of a compressed grid file, followed by a GRID_BAND per band giving
+// where its compressed rows are in the file. quantum is 0 for lossless files
+#define GRID_MAGIC "RLXG"
+#define GRID_VERSION 1
+
+typedef struct grid_header {
+    char magic[4];
+    int version;
+    int width;
+    int band_rows;
+    long long rows;
+    int band_count;
+    int reserved;
+    double quantum;
+} GRID_HEADER;
+
+typedef struct grid_band {
+    long long offset;
+    long long length;
+} GRID_BAND;
+
+// Compiles a hot kernel once for each x86-64 ISA level and picks the best one
+// the CPU supports when the program starts, so that a single portable binary
+// still gets the widest vectors available
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#define HOT_KERNEL __attribute__((target_clones("default", "arch=x86-64-v2", "arch=x86-64-v3", "arch=x86-64-v4")))
+#else
+#define HOT_KERNEL
+#endif
+
+// Relaxes the interior cells of row given the rows above and below it, writes
+// the new values to out and returns 1 if any value changed by more than tolerance
+typedef int (*ROW_KERNEL)(const double* up, const double* row, const double* down,
+        double* out, int width, double tolerance);
+
+// Relaxes the interior cells of row for the Poisson problem, as ROW_KERNEL does
+// for the Laplace problem. The coefficient rows are NULL for constant coefficients
+typedef int (*POISSON_ROW_KERNEL)(const double* up, const double* row, const double* down,
+        const double* source, const double* coefficient_up, const double* coefficient_row,
+        const double* coefficient_down, double* out, int width, double spacing_squared, double tolerance);
+
+// per thread counters kept when RELAXATION_INSTRUMENT is defined, padded to a
+// cache line so that threads never share one
+typedef struct worker_counters {
+    long long compute_nanoseconds;
+    long long wait_nanoseconds;
+    long long cells_updated;
+    long long iterations;
+    char padding[32];
+} WORKER_COUNTERS;
+
+// Returns the time in nanoseconds on a clock which never goes backwards
+static inline long long getMonotonicNanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+// Counting macros, which compile to nothing unless RELAXATION_INSTRUMENT is defined.
+// INSTRUMENT_ADD adds to a field of the counters of the given thread, the main
+// thread's being at index thread_count
+#ifdef RELAXATION_INSTRUMENT
+#define INSTRUMENT_ENABLED 1
+#define INSTRUMENT_ADD(thread, field, amount) (worker_counters[thread].field += (amount))
+#else
+#define INSTRUMENT_ENABLED 0
+#define INSTRUMENT_ADD(thread, field, amount)
+#endif
+
+// phases recorded in a trace
+#define TRACE_SWEEP 0
+#define TRACE_BARRIER_WAIT 1
+#define TRACE_CONVERGENCE_CHECK 2
+#define TRACE_UPDATE 3
+#define TRACE_BLOCK_UPDATE 4
+
+// PHASE_TIME declares a variable holding the current time when instrumenting or
+// tracing, and 0 otherwise. TRACE_PHASE records a phase of the given thread, the
+// main thread being 0 and the worker thread of blocks[i] being i+1, when tracing
+#define PHASE_TIME(variable) long long variable = (INSTRUMENT_ENABLED || trace_enabled) ? getMonotonicNanoseconds() : 0
+#define TRACE_PHASE(thread, phase, start, end) do { \
+        if (trace_enabled) { \
+            recordTraceEvent(thread, phase, start, end); \
+        } \
+    } while (0)
+
+// global state shared by the solver and its kernels
+extern int thread_count;
+extern double decimal_value;
+extern int value_change_flag;
+extern int matrix_size;
+extern int matrix_width;
+extern int matrix_height;
+extern int row_stride;
+extern int stencil;
+extern int dimensions;
+extern double* matrix;
+extern ROW_KERNEL row_kernel;
+extern int in_place;
+extern int backend;
+extern int quantise_output;
+extern int owned_rows;
+extern int solve_finished;
+extern int rank;
+extern int rank_count;
+extern int first_row;
+extern BLOCK* blocks;
+extern WORKER_COUNTERS* worker_counters;
+extern int trace_enabled;
+extern int perf_enabled;
+extern void (*process_block)(BLOCK* block);
+extern void (*update_values)();
+extern void (*update_block)(BLOCK* block);
+extern double* volume;
+extern double* next_volume;
+extern BOUNDARY boundaries[4];
+extern double* source;
+extern double* coefficients;
+extern POISSON_ROW_KERNEL poisson_row_kernel;
+extern double spacing_squared;
+extern int acceleration;
+extern int anderson_depth;
+
+int chooseRowStride(int width);
+double* makeGrid(int rows);
+void* makeCacheAligned(int count, size_t size);
 double* makeMatrix();
 BLOCK* makeBlocks();
 
-double getSuroundingAverage(int index);
+ROW_KERNEL selectRowKernel(int stencil, int width);
+int relaxVolumeRow(const double* row, const double* north, const double* south,
+        const double* above, const double* below, double* out,
+        int start_col, int end_col, double tolerance);
+POISSON_ROW_KERNEL selectPoissonRowKernel(int stencil, int variable);
+int isValidStencil(int stencil, int dimensions);
 void processBlock(BLOCK* block);
+void updateMatrix();
+
+double* makeVolume();
+BLOCK* makeVolumeBlocks(int decomposition);
+void processVolumeBlock(BLOCK* block);
+void updateVolume();
+
+double getEdgeValue(int i, int j);
+int parseBoundaries(char* specs);
+int hasNeumannBoundaries();
+double* loadGrid(char* argument);
+int setUpPoisson(char* source_argument, char* coefficient_argument, int stencil);
+void processPoissonBlock(BLOCK* block);
+void applyNeumannBoundaries();
+void updatePoissonMatrix();
+
+void makeInPlaceBuffers(BLOCK* block);
+double* getEdgeRow(BLOCK* block, int parity, int last);
+void processInPlaceBlock(BLOCK* block);
+void updateInPlace();
+
+void processChebyshevBlock(BLOCK* block);
+void updateChebyshev();
+void processAndersonBlock(BLOCK* block);
+void updateAnderson();
+void updateAndersonBlock(BLOCK* block);
+int parseAcceleration(char* spec);
+int setUpAcceleration(int stencil);
+
+void makeWorkerCounters();
+long long getBlockCells(BLOCK* block);
+void printWorkerCounters();
+
+void startTrace();
+void recordTraceEvent(int thread, int name, long long start, long long end);
+int writeTrace(char* file_name);
+
+void makeHardwareCounters();
+void startHardwareCounters(int thread);
+int isCountingHardware(int thread);
+void stopHardwareCounters();
+void beginHardwarePhase(int thread);
+void endHardwarePhase(int thread);
+long long getSweepCells();
+int getBytesPerCell();
+int getFlopsPerCell();
+void printHardwareCounters(double time_taken, long long iterations);
+
+int calibrateBandwidth(int max_threads);
+double getAttainableBandwidth(int threads);
+void printRoofline(double time_taken, long long iterations);
+
+void startPool(int workers);
+void stopPool();
+int reservePool();
+void releasePool();
+int startPoolPhase(void (*phase)(int worker));
+void finishPoolPhase();
+int getPoolWorker();
+void runParallelFor(int count, void (*task)(int index, void* argument), void* argument);
+double runParallelMax(int count, double (*task)(int index, void* argument), void* argument);
+
+void* initWorkerThread(void* vargp);
+void runBlockWorker(int worker);
+void applyFinalSweep();
+double getTimeTaken(struct timespec start_time, struct timespec end_time);
+long long solveWithBarriers(double* sequential_time_taken, double* parallel_time_taken);
+long long solveSequentially(double* sequential_time_taken, double* parallel_time_taken);
+long long solveWithPool(double* sequential_time_taken, double* parallel_time_taken);
+long long solveWithBackend(double* sequential_time_taken, double* parallel_time_taken);
+int solveCoarseLevels(int levels, int stencil, char* source_argument, char* coefficient_argument,
+        double* sequential_time_taken, double* parallel_time_taken);
+void interpolateCoarseSolution();
+
+int startOutput(char* file_name, double* values, double quantum);
+int finishOutput();
+int writeGrid(char* file_name, double* values);
+
+size_t getCompressedBandCapacity(long long count);
+size_t compressBand(const double* values, long long count, int width, double quantum, unsigned char* out);
+int decompressBand(const unsigned char* in, size_t length, long long count, int width, double quantum,
+        double* values);
+int isCompressedGrid(char* file_name);
+double* loadCompressedGrid(char* file_name, long long rows);
+
+int startDistribution(int* argc, char*** argv);
+void endDistribution();
+int setUpDistributedMatrix(char* input_file);
+double* getRankGrid(double* grid);
+long long solveDistributed(double* sequential_time_taken, double* parallel_time_taken);
+int gatherMatrix();
+
+int startJob();
+void serviceJob(long long iterations);
+int isJobCancelled();
+void getJobProgress(JOB_PROGRESS* progress);
+void cancelJob();
+double* takeSnapshot();
+long long waitForJob(double* sequential_time_taken, double* parallel_time_taken);
+void monitorJob(double interval, double time_limit, double checkpoint_interval, char* checkpoint_file);
 
 void printMatrix();
 void printMatrixBlocks();
-void printBlocks();
\ No newline at end of file
+void printBlocks();
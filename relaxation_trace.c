@@ -0,0 +1,104 @@
+/**
+* Execution trace
+* Oliver Redeyoff
+*
+* When a trace file is given, the worker threads and the main thread record the
+* start and end of every phase they go through (relaxing, waiting at a barrier,
+* checking for convergence and updating) and the events are written out as a
+* Chrome trace JSON file once the solve ends, which chrome://tracing or Perfetto
+* show as a timeline with a row per thread.
+*
+* Each thread records into its own ring buffer, which only that thread writes
+* to, so recording needs no locks: the event is filled in first and the buffer's
+* head is then advanced with a release store, so a reader which loads the head
+* with an acquire sees every event before it. When a buffer fills up the oldest
+* events are overwritten, so a long run keeps its last TRACE_BUFFER_EVENTS
+* events per thread.
+*
+**/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "relaxation_technique.h"
+
+// number of events kept per thread
+#define TRACE_BUFFER_EVENTS (1 << 16)
+
+typedef struct trace_event {
+    int name;
+    long long start;
+    long long end;
+} TRACE_EVENT;
+
+typedef struct trace_buffer {
+    TRACE_EVENT* events;
+    atomic_llong head;
+    char padding[48];
+} TRACE_BUFFER;
+
+int trace_enabled;
+
+// buffers of the main thread, at index 0, and each worker thread after it
+static TRACE_BUFFER* trace_buffers;
+static long long trace_start;
+
+static const char* event_names[] = {"sweep", "barrier wait", "convergence check", "update", "block update"};
+
+// Allocates a buffer for the main thread and every worker thread, and starts
+// the trace's clock
+void startTrace() {
+    trace_buffers = makeCacheAligned(thread_count+1, sizeof(TRACE_BUFFER));
+    for (int i=0 ; i<=thread_count ; i++) {
+        trace_buffers[i].events = malloc(TRACE_BUFFER_EVENTS*sizeof(TRACE_EVENT));
+        atomic_init(&trace_buffers[i].head, 0);
+    }
+    trace_start = getMonotonicNanoseconds();
+    trace_enabled = 1;
+}
+
+// Records an event of the given thread, 0 being the main thread and the worker
+// thread relaxing blocks[i] being i+1, which must only be called by that thread
+void recordTraceEvent(int thread, int name, long long start, long long end) {
+    TRACE_BUFFER* buffer = &trace_buffers[thread];
+    long long head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+
+    TRACE_EVENT* event = &buffer->events[head%TRACE_BUFFER_EVENTS];
+    event->name = name;
+    event->start = start;
+    event->end = end;
+
+    atomic_store_explicit(&buffer->head, head+1, memory_order_release);
+}
+
+// Writes every recorded event to the given file in the Chrome trace format.
+// Returns 0 on success and 1 if the file can't be written
+int writeTrace(char* file_name) {
+    FILE* file = fopen(file_name, "w");
+    if (file == NULL) {
+        printf("Could not open '%s'\n", file_name);
+        return 1;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"main\"}}");
+    for (int i=1 ; i<=thread_count ; i++) {
+        fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"worker %d\"}}", i, i-1);
+    }
+
+    for (int i=0 ; i<=thread_count ; i++) {
+        long long head = atomic_load_explicit(&trace_buffers[i].head, memory_order_acquire);
+        long long first = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+
+        for (long long e=first ; e<head ; e++) {
+            TRACE_EVENT* event = &trace_buffers[i].events[e%TRACE_BUFFER_EVENTS];
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    event_names[event->name], i, (event->start - trace_start)*1e-3, (event->end - event->start)*1e-3);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,172 @@
+/**
+* 3D relaxation
+* Oliver Redeyoff
+*
+* The volume is a cube of matrix_size^3 cells stored plane by plane, and is
+* relaxed with the 7 point stencil. Each worker thread is given either a slab
+* (a range of whole planes) or a pencil (a range of rows across a range of
+* planes) of the volume, and writes its new values straight into a second
+* volume which is swapped with the first one during the update step.
+*
+* Within its block a thread walks the volume in tiles of rows and columns,
+* sweeping each tile through all of the block's planes before moving on to the
+* next one, so that the three planes of a tile the stencil reads stay in cache
+* while they are reused.
+*
+**/
+
+
+#include <stdlib.h>
+#include <math.h>
+#include "relaxation_technique.h"
+
+// number of bytes of cache a tile (three planes read and one written) should fit in
+#define VOLUME_TILE_CACHE_BYTES (256*1024)
+// widest tile, in cells, so that tiles still have a useful number of rows
+#define VOLUME_TILE_MAX_WIDTH 512
+
+// the volume being relaxed, and the volume the new values are written to
+double* volume;
+double* next_volume;
+
+// Puts the initial values in the given plane of the volume given as argument
+static void initialisePlane(int k, void* argument) {
+    double* volume = argument;
+
+    for (int i=0 ; i<matrix_size ; i++) {
+        for (int j=0 ; j<matrix_size ; j++) {
+
+            // populate with 1.0 if on the first plane, row or column, else with 0.0
+            int index = (k*matrix_size + i)*matrix_size + j;
+            if (k==0 || i==0 || j==0) {
+                volume[index] = 1.0;
+            } else {
+                volume[index] = 0.0;
+            }
+
+        }
+    }
+}
+
+// Returns array of doubles of length matrix_size^3, initialised plane by plane
+// on the worker pool
+double* makeVolume() {
+    // allocate memory for new volume of given size
+    double* volume = malloc((size_t)matrix_size*matrix_size*matrix_size*sizeof(double));
+
+    // put initial values in volume
+    runParallelFor(matrix_size, initialisePlane, volume);
+
+    return volume;
+}
+
+// Splits count items starting at first into parts ranges whose sizes differ by at
+// most one, and stores the first and last item of the given part in start and end
+static void splitRange(int first, int count, int parts, int part, int* start, int* end) {
+    int equal_size = count/parts;
+    int extra = count%parts;
+
+    *start = first + equal_size*part + (part < extra ? part : extra);
+    *end = *start + equal_size + (part < extra ? 1 : 0) - 1;
+}
+
+// Returns the number of groups the planes are split into for a pencil
+// decomposition, which is the divisor of thread_count closest to its square root
+// so that pencils are as close to square as possible
+static int getPencilPlaneGroups() {
+    int plane_groups = 1;
+
+    for (int d=1 ; d*d<=thread_count ; d++) {
+        if (thread_count%d == 0) {
+            plane_groups = d;
+        }
+    }
+
+    return plane_groups;
+}
+
+// Returns thread_count number of blocks which each contain a range of planes and
+// a range of rows of the volume. A slab decomposition gives each block all the
+// rows of its planes, a pencil decomposition also splits the rows. No blocks
+// overlap and they cover all the mutable cells of the volume
+BLOCK* makeVolumeBlocks(int decomposition) {
+    BLOCK* blocks = malloc(thread_count*sizeof(BLOCK));
+
+    int mutatable_count = matrix_size - 2;
+    int plane_groups = thread_count;
+    if (decomposition == DECOMPOSITION_PENCIL) {
+        plane_groups = getPencilPlaneGroups();
+    }
+    int row_groups = thread_count/plane_groups;
+
+    for (int i=0 ; i<thread_count ; i++) {
+        BLOCK new_block;
+
+        splitRange(1, mutatable_count, plane_groups, i/row_groups, &new_block.start_plane, &new_block.end_plane);
+        splitRange(1, mutatable_count, row_groups, i%row_groups, &new_block.start_row, &new_block.end_row);
+        new_block.start_index = (new_block.start_plane*matrix_size + new_block.start_row)*matrix_size;
+        new_block.end_index = (new_block.end_plane*matrix_size + new_block.end_row + 1)*matrix_size - 1;
+
+        // new values are written straight to next_volume
+        new_block.new_values = NULL;
+
+        blocks[i] = new_block;
+    }
+
+    return blocks;
+}
+
+// Performs relaxation for the cells of volume defined in the given block, storing
+// the results in next_volume
+void processVolumeBlock(BLOCK* block) {
+    int plane_size = matrix_size*matrix_size;
+    int changed = 0;
+
+    // size tiles so that the three planes read and the one written fit in cache
+    int tile_width = matrix_size - 2;
+    if (tile_width > VOLUME_TILE_MAX_WIDTH) {
+        tile_width = VOLUME_TILE_MAX_WIDTH;
+    }
+    int tile_rows = VOLUME_TILE_CACHE_BYTES/(4*tile_width*(int)sizeof(double));
+    if (tile_rows < 1) {
+        tile_rows = 1;
+    }
+
+    for (int tile_row=block->start_row ; tile_row<=block->end_row ; tile_row+=tile_rows) {
+        int last_row = tile_row + tile_rows - 1;
+        if (last_row > block->end_row) {
+            last_row = block->end_row;
+        }
+
+        for (int tile_col=1 ; tile_col<matrix_size-1 ; tile_col+=tile_width) {
+            int end_col = tile_col + tile_width;
+            if (end_col > matrix_size-1) {
+                end_col = matrix_size-1;
+            }
+
+            // sweep the tile through every plane of the block
+            for (int plane=block->start_plane ; plane<=block->end_plane ; plane++) {
+                for (int row=tile_row ; row<=last_row ; row++) {
+                    size_t index = (size_t)plane*plane_size + (size_t)row*matrix_size;
+                    double* current_row = &volume[index];
+
+                    changed |= relaxVolumeRow(current_row, current_row - matrix_size, current_row + matrix_size,
+                            current_row - plane_size, current_row + plane_size, &next_volume[index],
+                            tile_col, end_col, decimal_value);
+                }
+            }
+        }
+    }
+
+    if (changed) {
+        value_change_flag = 1;
+    }
+}
+
+// Makes the new values the current ones by swapping the two volumes, which works
+// because both volumes were created with the same edge values
+void updateVolume() {
+    double* swap = volume;
+    volume = next_volume;
+    next_volume = swap;
+}
@@ -0,0 +1,295 @@
+#!/bin/sh
+#
+# Scaling report generator for benchmark.sh results
+#
+# Reads one or more CSV files written by benchmark.sh and, for every size,
+# precision and variant, works out against the single thread time:
+#   speedup           S(p) = T(1)/T(p)
+#   efficiency        E(p) = S(p)/p
+#   karp_flatt        serial fraction implied by S(p), (1/S - 1/p)/(1 - 1/p)
+#   amdahl_fit        serial fraction s fitted by least squares to every T(p) of
+#                     the group with T(p) = T(1)(s + (1-s)/p)
+#   serial_fraction   measured share of the run spent in the sequential part,
+#                     sequential/(sequential + parallel), from the phase times
+#   amdahl_limit      speedup 1/(f + (1-f)/p) allowed by the serial fraction f
+#                     measured on the single thread run, or by the fitted one
+#                     when the group has no single thread phase times
+#   gustafson         scaled speedup p - f(p-1) for the serial fraction f
+#                     measured on the p thread run
+#
+# The single thread time comes from a 1 thread row of the same group or, failing
+# that, from a 1 thread row with the same size and precision in the file given
+# with -q (such as the sequential backend's results). Groups without either get no
+# speedup figures rather than guessed ones.
+#
+# Charts against size plot N for an N size and sqrt(W*H), the side of the square
+# with as many cells, for a WxH size.
+#
+# Writes prefix.csv with a row per result and prefix.html, a self contained page
+# with the same tables and SVG charts which needs no external scripts.
+#
+# Usage: sh report.sh [-q sequential.csv] [-o prefix] results.csv...
+#
+
+PREFIX=report
+BASELINE=""
+
+while getopts "q:o:" option
+do
+    case $option in
+        q) BASELINE=$OPTARG ;;
+        o) PREFIX=$OPTARG ;;
+        *) sed -n '/^# Usage/,/^$/p' "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND-1))
+
+if [ $# -eq 0 ]
+then
+    sed -n '/^# Usage/,/^$/p' "$0"
+    exit 1
+fi
+
+awk -v baseline_file="$BASELINE" -v csv_file="$PREFIX.csv" -v html_file="$PREFIX.html" '
+# splits a CSV line into fields, allowing quoted fields to hold commas
+function parse(line, fields,    count, field, quoted, i, c) {
+    count = 0; field = ""; quoted = 0
+    for (i=1 ; i<=length(line) ; i++) {
+        c = substr(line, i, 1)
+        if (c == "\"") {
+            quoted = !quoted
+        } else if (c == "," && !quoted) {
+            fields[++count] = trim(field); field = ""
+        } else {
+            field = field c
+        }
+    }
+    fields[++count] = trim(field)
+    return count
+}
+
+function trim(text) {
+    gsub(/^[ \t]+|[ \t\r]+$/, "", text)
+    return text
+}
+
+function html_escape(text) {
+    gsub(/&/, "\\&amp;", text); gsub(/</, "\\&lt;", text); gsub(/>/, "\\&gt;", text)
+    return text
+}
+
+# the position of a size on a chart axis, N for N and sqrt(W*H) for WxH
+function size_axis(size,    sides) {
+    if (split(size, sides, "x") == 2) return sqrt(sides[1]*sides[2])
+    return size + 0
+}
+
+# reads a benchmark.sh CSV file, skipping its header
+function load(file, is_baseline,    line, fields, count, key) {
+    while ((getline line < file) > 0) {
+        count = parse(line, fields)
+        if (count < 4 || fields[1] == "size") continue
+
+        if (is_baseline) {
+            if (fields[2] == 1) baseline[fields[1] SUBSEP fields[3]] = fields[4]
+            continue
+        }
+
+        variant = count >= 10 ? fields[10] : "default"
+        key = fields[1] SUBSEP fields[3] SUBSEP variant
+        if (!(key in group_seen)) {
+            group_seen[key] = 1
+            groups[++group_count] = key
+        }
+        if (!((key SUBSEP fields[2]) in time)) {
+            group_threads[key] = group_threads[key] " " fields[2]
+        }
+        time[key SUBSEP fields[2]] = fields[4]
+        sequential[key SUBSEP fields[2]] = count >= 8 ? fields[7] : ""
+        parallel[key SUBSEP fields[2]] = count >= 8 ? fields[8] : ""
+    }
+    close(file)
+}
+
+# sorts the numbers in a space separated list
+function sort_numbers(list, sorted,    count, i, j, swap) {
+    count = split(list, sorted, " ")
+    for (i=2 ; i<=count ; i++)
+        for (j=i ; j>1 && sorted[j-1]+0 > sorted[j]+0 ; j--) {
+            swap = sorted[j]; sorted[j] = sorted[j-1]; sorted[j-1] = swap
+        }
+    return count
+}
+
+function format(value) {
+    return value == "" ? "n/a" : sprintf("%.4f", value)
+}
+
+# starts a new chart, whose series are then added with add_point
+function new_chart(title, x_label, y_label) {
+    chart_title = title; chart_x_label = x_label; chart_y_label = y_label
+    series_count = 0
+    delete series_name; delete series_points; delete point_x; delete point_y
+}
+
+function add_point(name, x, y,    s) {
+    for (s=1 ; s<=series_count ; s++) if (series_name[s] == name) break
+    if (s > series_count) {
+        series_count = s; series_name[s] = name; series_points[s] = 0
+    }
+    series_points[s]++
+    point_x[s, series_points[s]] = x
+    point_y[s, series_points[s]] = y
+}
+
+# draws the current chart as an inline SVG line chart
+function draw_chart(    width, height, left, right, top, bottom, s, i, x_min, x_max, y_min, y_max, first, tick, value, x, y, points, colour) {
+    width = 720; height = 420; left = 70; right = 170; top = 40; bottom = 50
+    first = 1
+    for (s=1 ; s<=series_count ; s++)
+        for (i=1 ; i<=series_points[s] ; i++) {
+            if (first || point_x[s,i] < x_min) x_min = point_x[s,i]
+            if (first || point_x[s,i] > x_max) x_max = point_x[s,i]
+            if (first || point_y[s,i] > y_max) y_max = point_y[s,i]
+            first = 0
+        }
+    if (first) return
+    y_min = 0
+    if (x_max == x_min) x_max = x_min + 1
+    if (y_max <= y_min) y_max = y_min + 1
+
+    printf "<h3>%s</h3>\n<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" font-family=\"sans-serif\" font-size=\"12\">\n", html_escape(chart_title), width, height > html_file
+    printf "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"none\" stroke=\"#999\"/>\n", left, top, width-left-right, height-top-bottom > html_file
+    for (tick=0 ; tick<=5 ; tick++) {
+        value = x_min + (x_max-x_min)*tick/5
+        x = left + (width-left-right)*tick/5
+        printf "<text x=\"%.1f\" y=\"%d\" text-anchor=\"middle\">%g</text>\n", x, height-bottom+18, value > html_file
+        value = y_min + (y_max-y_min)*tick/5
+        y = height - bottom - (height-top-bottom)*tick/5
+        printf "<line x1=\"%d\" y1=\"%.1f\" x2=\"%d\" y2=\"%.1f\" stroke=\"#eee\"/>\n", left, y, width-right, y > html_file
+        printf "<text x=\"%d\" y=\"%.1f\" text-anchor=\"end\">%.3g</text>\n", left-6, y+4, value > html_file
+    }
+    printf "<text x=\"%d\" y=\"%d\" text-anchor=\"middle\">%s</text>\n", left+(width-left-right)/2, height-10, html_escape(chart_x_label) > html_file
+    printf "<text x=\"16\" y=\"%d\" text-anchor=\"middle\" transform=\"rotate(-90 16 %d)\">%s</text>\n", top+(height-top-bottom)/2, top+(height-top-bottom)/2, html_escape(chart_y_label) > html_file
+
+    for (s=1 ; s<=series_count ; s++) {
+        colour = colours[(s-1)%colour_count + 1]
+        points = ""
+        for (i=1 ; i<=series_points[s] ; i++) {
+            x = left + (width-left-right)*(point_x[s,i]-x_min)/(x_max-x_min)
+            y = height - bottom - (height-top-bottom)*(point_y[s,i]-y_min)/(y_max-y_min)
+            points = points sprintf("%.1f,%.1f ", x, y)
+            printf "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"2.5\" fill=\"%s\"/>\n", x, y, colour > html_file
+        }
+        printf "<polyline points=\"%s\" fill=\"none\" stroke=\"%s\" stroke-width=\"2\"/>\n", points, colour > html_file
+        printf "<rect x=\"%d\" y=\"%d\" width=\"12\" height=\"12\" fill=\"%s\"/>\n", width-right+12, top+(s-1)*18, colour > html_file
+        printf "<text x=\"%d\" y=\"%d\">%s</text>\n", width-right+30, top+(s-1)*18+11, html_escape(series_name[s]) > html_file
+    }
+    print "</svg>" > html_file
+}
+
+BEGIN {
+    colour_count = split("#e6194B #3cb44b #4363d8 #f58231 #911eb4 #42d4f4 #f032e6 #bfef45 #800000 #808000 #000075", colours, " ")
+}
+
+{ files[++file_count] = FILENAME; nextfile }
+
+END {
+    if (baseline_file != "") load(baseline_file, 1)
+    for (f=1 ; f<=file_count ; f++) load(files[f], 0)
+
+    print "size, threads, precision, variant, time, speedup, efficiency, karp_flatt, amdahl_fit, serial_fraction, amdahl_limit, gustafson" > csv_file
+
+    print "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>Relaxation scaling report</title>" > html_file
+    print "<style>body{font-family:sans-serif;margin:2em}table{border-collapse:collapse;margin-bottom:2em}td,th{border:1px solid #ccc;padding:3px 8px;text-align:right}th{background:#f3f3f3}</style>" > html_file
+    print "</head>\n<body>\n<h1>Relaxation scaling report</h1>" > html_file
+    printf "<p>Generated from %s.</p>\n", html_escape(files_list()) > html_file
+
+    for (g=1 ; g<=group_count ; g++) {
+        key = groups[g]
+        split(key, parts, SUBSEP)
+        size = parts[1]; precision = parts[2]; variant = parts[3]
+        count = sort_numbers(group_threads[key], threads)
+
+        single = ((key SUBSEP 1) in time) ? time[key SUBSEP 1] : ""
+        if (single == "" && ((size SUBSEP precision) in baseline)) single = baseline[size SUBSEP precision]
+
+        # least squares fit of T(p)/T(1) - 1/p = s(1 - 1/p) over the group
+        fit = ""
+        if (single != "") {
+            sum_xy = 0; sum_xx = 0
+            for (i=1 ; i<=count ; i++) {
+                p = threads[i]; if (p <= 1) continue
+                x = 1 - 1/p; y = time[key SUBSEP p]/single - 1/p
+                sum_xy += x*y; sum_xx += x*x
+            }
+            if (sum_xx > 0) fit = sum_xy/sum_xx
+        }
+
+        # serial fraction of the single thread run, from its phase times
+        amdahl = fit
+        phases = sequential[key SUBSEP 1] + parallel[key SUBSEP 1]
+        if (sequential[key SUBSEP 1] != "" && phases > 0) amdahl = sequential[key SUBSEP 1]/phases
+
+        printf "<h2>Size %s, precision %s, variant %s</h2>\n", size, precision, html_escape(variant) > html_file
+        printf "<p>Single thread time: %s s. Fitted Amdahl serial fraction: %s. Serial fraction used for the Amdahl limit: %s.</p>\n", single == "" ? "not measured" : single, format(fit), format(amdahl) > html_file
+        print "<table>\n<tr><th>Threads</th><th>Time (s)</th><th>Speedup</th><th>Efficiency</th><th>Karp-Flatt</th><th>Measured serial fraction</th><th>Amdahl limit</th><th>Gustafson speedup</th></tr>" > html_file
+
+        for (i=1 ; i<=count ; i++) {
+            p = threads[i]
+            t = time[key SUBSEP p]
+            speedup = ""; efficiency = ""; karp_flatt = ""; limit = ""; serial = ""; gustafson = ""
+            if (single != "" && t > 0) {
+                speedup = single/t
+                efficiency = speedup/p
+                if (p > 1) karp_flatt = (1/speedup - 1/p)/(1 - 1/p)
+            }
+            if (amdahl != "") limit = 1/(amdahl + (1-amdahl)/p)
+            phases = sequential[key SUBSEP p] + parallel[key SUBSEP p]
+            if (sequential[key SUBSEP p] != "" && phases > 0) {
+                serial = sequential[key SUBSEP p]/phases
+                gustafson = p - serial*(p-1)
+            }
+
+            printf "%s, %s, %s, \"%s\", %s, %s, %s, %s, %s, %s, %s, %s\n", size, p, precision, variant, t, format(speedup), format(efficiency), format(karp_flatt), format(fit), format(serial), format(limit), format(gustafson) > csv_file
+            printf "<tr><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td></tr>\n", p, t, format(speedup), format(efficiency), format(karp_flatt), format(serial), format(limit), format(gustafson) > html_file
+
+            label = "size " size " " variant
+            if (speedup != "") {
+                speedup_points[++speedup_count] = label SUBSEP p SUBSEP speedup
+                efficiency_points[speedup_count] = label SUBSEP p SUBSEP efficiency
+            }
+            if (limit != "") limit_points[++limit_count] = label " Amdahl" SUBSEP p SUBSEP limit
+            if (gustafson != "") gustafson_points[++gustafson_count] = ("threads " p " " variant) SUBSEP size_axis(size) SUBSEP gustafson
+            time_points[++time_count] = ("threads " p " " variant) SUBSEP size_axis(size) SUBSEP t
+        }
+        print "</table>" > html_file
+    }
+
+    print "<h2>Charts</h2>" > html_file
+    new_chart("Speedup against thread count", "Threads", "Speedup")
+    for (i=1 ; i<=speedup_count ; i++) { split(speedup_points[i], point, SUBSEP); add_point(point[1], point[2], point[3]) }
+    for (i=1 ; i<=limit_count ; i++) { split(limit_points[i], point, SUBSEP); add_point(point[1], point[2], point[3]) }
+    draw_chart()
+
+    new_chart("Efficiency against thread count", "Threads", "Efficiency")
+    for (i=1 ; i<=speedup_count ; i++) { split(efficiency_points[i], point, SUBSEP); add_point(point[1], point[2], point[3]) }
+    draw_chart()
+
+    new_chart("Gustafson scaled speedup against size", "Matrix size", "Scaled speedup")
+    for (i=1 ; i<=gustafson_count ; i++) { split(gustafson_points[i], point, SUBSEP); add_point(point[1], point[2], point[3]) }
+    draw_chart()
+
+    new_chart("Time against size", "Matrix size", "Time (s)")
+    for (i=1 ; i<=time_count ; i++) { split(time_points[i], point, SUBSEP); add_point(point[1], point[2], point[3]) }
+    draw_chart()
+
+    print "</body>\n</html>" > html_file
+}
+
+function files_list(    f, list) {
+    for (f=1 ; f<=file_count ; f++) list = list (f > 1 ? ", " : "") files[f]
+    if (baseline_file != "") list = list " with single thread times from " baseline_file
+    return list
+}
+' "$@"
@@ -1,6 +1 @@
-make p
-
-for i in {1..10}
-do
-   ./relaxation $(($i*100)) 44 3
-done
\ No newline at end of file
+sh benchmark.sh -m p -s "100 200 300 400 500 600 700 800 900 1000" -t 44 -p 3 -o gustafson
\ No newline at end of file
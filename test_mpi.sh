@@ -0,0 +1 @@
+sh benchmark.sh -m mpi -l "mpirun -np 4" -s 2048 -t "1 2 4 8 11" -p 3 -v "-x mpi" -o mpi
\ No newline at end of file
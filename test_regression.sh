@@ -0,0 +1,389 @@
+#!/bin/sh
+#
+# Regression suite for the relaxation solver
+#
+# Checks three things, and exits with 1 if any check fails:
+#
+# 1 - consistency: every variant gives bit-identical output with every backend
+#     and thread count, compared with the sequential backend on the same blocks,
+#     and in place relaxation (-i) gives the same output as the copying scheme.
+#     The sizes include widths with fixed width kernels and one without, a
+#     rectangle (WxH), and the variants a padded row stride (-L)
+#
+# 2 - accuracy: problems whose solution is known are solved to within the
+#     tolerance of it, by every kernel, acceleration and backend. The 5 and 9
+#     point stencils are exact for quadratics, so the only error left is how far
+#     the iteration stops from converging:
+#       - the harmonic u = x^2 - y^2, with its values on the edges given by an
+#         input file
+#       - the Poisson problem -u'' = 2 with u = 0 on the left and right sides
+#         and no flux through the top and bottom, whose solution is x(1 - x).
+#       - the harmonic u = 1 - x with u = 0 on the right side and Neumann
+#         conditions on the other three, so that two corners lie between
+#         Neumann sides and are read by the 9 point stencil
+#         Anderson acceleration and the MPI backend don't support Neumann
+#         sides, so Anderson only solves the harmonic and the MPI backend is
+#         given the Poisson problem's edges in an input file instead and
+#         leaves out the Neumann corners
+#     both on squares and on a rectangle, whose grid spacing is set by its width
+#
+# 3 - performance: the median time of each timing case is compared with the
+#     baseline recorded for this host in the baseline file, and fails if it is
+#     slower by more than the allowed factor. Only -u records baselines, so
+#     cases without one are skipped until it is run
+#
+# Usage: sh test_regression.sh [options]
+#   -b binary       solver to test (default ./relaxation)
+#   -m target       make target to build before testing (default p)
+#   -l launcher     command to run the MPI backend through, e.g. "mpirun -np 3",
+#                   which needs a binary built with make mpi (default none,
+#                   which leaves the MPI backend out)
+#   -t threads      space separated thread counts (default "1 3 4")
+#   -f factor       largest allowed slowdown against the baseline (default 1.25)
+#   -r repetitions  timed runs per timing case (default 3)
+#   -B file         baseline file (default regression_baseline.csv)
+#   -u              record the baseline instead of comparing with it, which
+#                   is the only way a baseline is created
+#   -n              skip the timing cases
+#
+
+BINARY=./relaxation
+TARGET=p
+LAUNCHER=""
+THREADS="1 3 4"
+FACTOR=1.25
+REPETITIONS=3
+BASELINE=regression_baseline.csv
+UPDATE=0
+TIMING=1
+
+while getopts "b:m:l:t:f:r:B:un" option
+do
+    case $option in
+        b) BINARY=$OPTARG ;;
+        m) TARGET=$OPTARG ;;
+        l) LAUNCHER=$OPTARG ;;
+        t) THREADS=$OPTARG ;;
+        f) FACTOR=$OPTARG ;;
+        r) REPETITIONS=$OPTARG ;;
+        B) BASELINE=$OPTARG ;;
+        u) UPDATE=1 ;;
+        n) TIMING=0 ;;
+        *) sed -n '/^# Usage/,/^$/p' "$0"; exit 1 ;;
+    esac
+done
+
+# variants checked for consistency, ';' separated as in benchmark.sh
+VARIANTS="default;-k 9;-i;-a chebyshev;-a anderson;-r 1;-r 1 -c 2;-r 1 -b top:n:0,bottom:n:0.5;-i -b left:n:0;-M 3;-L 104;-i -L 104;-d 3;-d 3 -D pencil"
+# 64 has fixed width kernels, 65 the generic ones, and 96x40 is a rectangle
+CONSISTENCY_SIZES="65 64 96x40"
+IN_PLACE_VARIANTS="default;-k 9;-r 1;-r 1 -c 2;-r 1 -b top:n:0,bottom:n:0.5;-b left:n:0;-L 104"
+VOLUME_SIZE=20
+CONSISTENCY_PRECISION=6
+
+# sizes, precision and largest allowed error of the accuracy checks, 32 having
+# fixed width kernels, 33 the generic ones and 32x17 being a rectangle
+ACCURACY_SIZES="33 32 32x17"
+ACCURACY_PRECISION=10
+ACCURACY_TOLERANCE=1e-6
+ACCURACY_VARIANTS="default;-k 9;-i;-a chebyshev;-a anderson;-x sequential;-x pool"
+
+# timing cases, each the arguments of one run
+TIMING_CASES="200 1 5 -x sequential;200 4 5 -x barrier;200 4 5 -x pool;200 4 5 -i;300 4 8 -a chebyshev"
+
+if [ -n "$TARGET" ]
+then
+    make "$TARGET" >&2 || exit 1
+fi
+if [ ! -x "$BINARY" ]
+then
+    echo "No solver at $BINARY, build it or pass -m <target>" >&2
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FAILURES=0
+
+pass() {
+    echo "PASS $1"
+}
+
+fail() {
+    echo "FAIL $1"
+    FAILURES=$((FAILURES + 1))
+}
+
+# returns 0 if the MPI backend supports the given variant
+mpi_supports() {
+    case " $1 " in
+        *" -i "*|*" -a "*|*" -d 3"*|*":n:"*|*" -M "*) return 1 ;;
+    esac
+    return 0
+}
+
+# runs the solver with the given arguments, writing its output to the file
+# given first and what it prints to $WORK/log, and returns its exit status
+solve() {
+    output=$1
+    shift
+    $BINARY "$@" -o "$output" > "$WORK/log" 2>&1
+}
+
+# 1 - consistency
+IFS=';'
+for variant in $VARIANTS
+do
+    unset IFS
+    [ "$variant" = "default" ] && arguments="" || arguments=$variant
+    sizes=$CONSISTENCY_SIZES
+    case " $arguments " in
+        *" -d 3"*) sizes=$VOLUME_SIZE ;;
+    esac
+
+    for size in $sizes
+    do
+        for threads in $THREADS
+        do
+            name="consistency [$variant] size $size, $threads threads"
+            if ! solve "$WORK/sequential.txt" $size $threads $CONSISTENCY_PRECISION -x sequential $arguments
+            then
+                fail "$name: sequential backend failed: $(tail -n 1 "$WORK/log")"
+                continue
+            fi
+
+            for backend in barrier pool mpi
+            do
+                if [ $backend = mpi ]
+                then
+                    if [ -z "$LAUNCHER" ] || ! mpi_supports "$arguments"
+                    then
+                        continue
+                    fi
+                    $LAUNCHER $BINARY $size $threads $CONSISTENCY_PRECISION -x mpi $arguments \
+                            -o "$WORK/$backend.txt" > "$WORK/log" 2>&1
+                else
+                    solve "$WORK/$backend.txt" $size $threads $CONSISTENCY_PRECISION -x $backend $arguments
+                fi
+
+                if [ $? -ne 0 ]
+                then
+                    fail "$name: $backend backend failed: $(tail -n 1 "$WORK/log")"
+                elif cmp -s "$WORK/sequential.txt" "$WORK/$backend.txt"
+                then
+                    pass "$name: $backend backend"
+                else
+                    fail "$name: $backend backend differs from the sequential backend"
+                fi
+            done
+        done
+    done
+    IFS=';'
+done
+unset IFS
+
+IFS=';'
+for variant in $IN_PLACE_VARIANTS
+do
+    unset IFS
+    [ "$variant" = "default" ] && arguments="" || arguments=$variant
+
+    for size in $CONSISTENCY_SIZES
+    do
+        for threads in $THREADS
+        do
+            name="consistency in place [$variant] size $size, $threads threads"
+            if ! solve "$WORK/copying.txt" $size $threads $CONSISTENCY_PRECISION $arguments
+            then
+                fail "$name: copying scheme failed: $(tail -n 1 "$WORK/log")"
+            elif ! solve "$WORK/in_place.txt" $size $threads $CONSISTENCY_PRECISION -i $arguments
+            then
+                fail "$name: in place relaxation failed: $(tail -n 1 "$WORK/log")"
+            elif cmp -s "$WORK/copying.txt" "$WORK/in_place.txt"
+            then
+                pass "$name"
+            else
+                fail "$name: differs from the copying scheme"
+            fi
+        done
+    done
+    IFS=';'
+done
+unset IFS
+
+# 2 - accuracy
+
+# prints the width of a size, N or WxH
+size_width() {
+    echo "${1%%x*}"
+}
+
+# prints the height of a size, N or WxH
+size_height() {
+    echo "${1##*x}"
+}
+
+# prints the largest difference between the grid in the given file, of the
+# given size, and the named solution, x^2 - y^2 (harmonic), x(1 - x)
+# (poisson) or 1 - x (corners), with x running along the rows from 0 to 1 and y down the columns
+# with the same spacing
+max_error() {
+    awk -v width=$(size_width $3) -v solution=$2 '
+        {
+            for (j=1 ; j<=NF ; j++) {
+                x = (j-1)/(width-1)
+                y = (NR-1)/(width-1)
+                if (solution == "harmonic") expected = x*x - y*y
+                else if (solution == "poisson") expected = x*(1 - x)
+                else expected = 1 - x
+                error = $j - expected
+                if (error < 0) error = -error
+                if (error > largest) largest = error
+            }
+        }
+        END { printf "%g\n", largest }' "$1"
+}
+
+# writes the named solution's values on the edges of a grid of the given size,
+# with 0 for the interior to start from, to the given file
+write_edges() {
+    awk -v width=$(size_width $2) -v height=$(size_height $2) -v solution=$1 'BEGIN {
+        for (i=0 ; i<height ; i++) {
+            for (j=0 ; j<width ; j++) {
+                x = j/(width-1)
+                y = i/(width-1)
+                edge = i == 0 || j == 0 || i == height-1 || j == width-1
+                value = solution == "harmonic" ? x*x - y*y : x*(1 - x)
+                printf "%.17g%s", edge ? value : 0, j < width-1 ? " " : "\n"
+            }
+        }
+    }' > "$3"
+}
+
+# checks the grid in $WORK/accuracy.txt against the named solution, given the
+# check's name, the problem and the size
+check_accuracy() {
+    error=$(max_error "$WORK/accuracy.txt" $2 $3)
+    if awk -v error="$error" -v tolerance=$ACCURACY_TOLERANCE 'BEGIN { exit !(error <= tolerance) }'
+    then
+        pass "$1: error $error"
+    else
+        fail "$1: error $error is over $ACCURACY_TOLERANCE"
+    fi
+}
+
+for size in $ACCURACY_SIZES
+do
+    write_edges harmonic $size "$WORK/harmonic_edges.txt"
+    write_edges poisson $size "$WORK/poisson_edges.txt"
+
+    IFS=';'
+    for variant in $ACCURACY_VARIANTS
+    do
+        unset IFS
+        [ "$variant" = "default" ] && arguments="" || arguments=$variant
+
+        for problem in harmonic poisson corners
+        do
+            name="accuracy $problem [$variant] size $size"
+            if [ $problem = harmonic ]
+            then
+                problem_arguments="-f $WORK/harmonic_edges.txt"
+            else
+                case " $arguments " in
+                    *" -a anderson "*) continue ;;
+                esac
+                if [ $problem = poisson ]
+                then
+                    problem_arguments="-r 2 -b top:n:0,bottom:n:0,left:d:0,right:d:0"
+                else
+                    problem_arguments="-r 0 -b top:n:0,left:n:1,bottom:n:0,right:d:0"
+                fi
+            fi
+
+            if ! solve "$WORK/accuracy.txt" $size 3 $ACCURACY_PRECISION $problem_arguments $arguments
+            then
+                fail "$name: solver failed: $(tail -n 1 "$WORK/log")"
+                continue
+            fi
+            check_accuracy "$name" $problem $size
+        done
+        IFS=';'
+    done
+    unset IFS
+
+    if [ -n "$LAUNCHER" ]
+    then
+        for problem in harmonic poisson
+        do
+            name="accuracy $problem [-x mpi] size $size"
+            if [ $problem = harmonic ]
+            then
+                problem_arguments="-f $WORK/harmonic_edges.txt"
+            else
+                problem_arguments="-r 2 -f $WORK/poisson_edges.txt"
+            fi
+
+            if ! $LAUNCHER $BINARY $size 3 $ACCURACY_PRECISION -x mpi $problem_arguments \
+                    -o "$WORK/accuracy.txt" > "$WORK/log" 2>&1
+            then
+                fail "$name: solver failed: $(tail -n 1 "$WORK/log")"
+                continue
+            fi
+            check_accuracy "$name" $problem $size
+        done
+    fi
+done
+
+# 3 - performance
+if [ $TIMING -eq 1 ]
+then
+    HOST=$(hostname)
+    if [ $UPDATE -eq 1 ]
+    then
+        touch "$BASELINE"
+    fi
+
+    IFS=';'
+    for timing_case in $TIMING_CASES
+    do
+        unset IFS
+        times=""
+        for repetition in $(seq "$REPETITIONS")
+        do
+            time=$($BINARY $timing_case 2> /dev/null | awk -F', ' 'NR == 1 { print $2 }')
+            times="$times $time"
+        done
+        median=$(echo $times | tr ' ' '\n' | sort -g | awk '{ values[NR] = $1 } END { print values[int((NR+1)/2)] }')
+        name="timing [$timing_case]"
+
+        baseline=""
+        if [ -f "$BASELINE" ]
+        then
+            baseline=$(awk -F, -v host="$HOST" -v name="$timing_case" '$1 == host && $2 == name { print $3 }' "$BASELINE")
+        fi
+        if [ -z "$median" ]
+        then
+            fail "$name: solver failed"
+        elif [ $UPDATE -eq 1 ]
+        then
+            awk -F, -v host="$HOST" -v name="$timing_case" '!($1 == host && $2 == name)' "$BASELINE" > "$WORK/baseline"
+            echo "$HOST,$timing_case,$median" >> "$WORK/baseline"
+            cp "$WORK/baseline" "$BASELINE"
+            pass "$name: recorded $median seconds as the baseline"
+        elif [ -z "$baseline" ]
+        then
+            echo "SKIP $name: $median seconds, no baseline for $HOST, record one with -u"
+        elif awk -v time=$median -v baseline=$baseline -v factor=$FACTOR 'BEGIN { exit !(time <= baseline*factor) }'
+        then
+            pass "$name: $median seconds, baseline $baseline"
+        else
+            fail "$name: $median seconds is over $FACTOR times the baseline $baseline"
+        fi
+        IFS=';'
+    done
+    unset IFS
+fi
+
+echo "$FAILURES failed"
+[ $FAILURES -eq 0 ]
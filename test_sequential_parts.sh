@@ -1,6 +1 @@
-make s
-
-for i in {1..10}
-do
-   ./relaxation $((100*$i)) 3
-done
\ No newline at end of file
+sh benchmark.sh -m p -S -s "100 200 300 400 500 600 700 800 900 1000" -p 3 -o sequential_parts
\ No newline at end of file
@@ -1,6 +1 @@
-make p
-
-for i in {1..11}
-do
-   ./relaxation 2048 $(($i*4)) 3
-done
\ No newline at end of file
+sh benchmark.sh -m p -s 2048 -t "4 8 12 16 20 24 28 32 36 40 44" -p 3 -o speedup
\ No newline at end of file